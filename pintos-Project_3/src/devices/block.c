@@ -99,17 +99,18 @@ block_get_by_name (const char *name)
   return NULL;
 }
 
-/* Verifies that SECTOR is a valid offset within BLOCK.
-   Panics if not. */
+/* Verifies that the CNT sectors starting at SECTOR are valid
+   offsets within BLOCK.  Panics if not. */
 static void
-check_sector (struct block *block, block_sector_t sector)
+check_sectors (struct block *block, block_sector_t sector, block_sector_t cnt)
 {
-  if (sector >= block->size)
+  if (cnt == 0 || sector >= block->size || cnt > block->size - sector)
     {
       /* We do not use ASSERT because we want to panic here
          regardless of whether NDEBUG is defined. */
       PANIC ("Access past end of device %s (sector=%"PRDSNu", "
-             "size=%"PRDSNu")\n", block_name (block), sector, block->size);
+             "cnt=%"PRDSNu", size=%"PRDSNu")\n",
+             block_name (block), sector, cnt, block->size);
     }
 }
 
@@ -120,9 +121,7 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
-  check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  block_read_multiple (block, sector, buffer, 1);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -133,10 +132,38 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
-  check_sector (block, sector);
+  block_write_multiple (block, sector, buffer, 1);
+}
+
+/* Reads CNT consecutive sectors starting at SECTOR from BLOCK
+   into BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes.  The driver moves them in as few requests as it can, so
+   this is much cheaper than CNT calls to block_read().
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_multiple (struct block *block, block_sector_t sector,
+                     void *buffer, block_sector_t cnt)
+{
+  check_sectors (block, sector, cnt);
+  block->ops->read (block->aux, sector, buffer, cnt);
+  block->read_cnt += cnt;
+}
+
+/* Writes CNT consecutive sectors starting at SECTOR to BLOCK
+   from BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Returns after the block device has acknowledged receiving all
+   of the data.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_multiple (struct block *block, block_sector_t sector,
+                      const void *buffer, block_sector_t cnt)
+{
+  check_sectors (block, sector, cnt);
   ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  block->ops->write (block->aux, sector, buffer, cnt);
+  block->write_cnt += cnt;
 }
 
 /* Returns the number of sectors in BLOCK. */
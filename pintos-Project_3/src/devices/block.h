@@ -53,6 +53,10 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multiple (struct block *, block_sector_t, void *,
+                          block_sector_t cnt);
+void block_write_multiple (struct block *, block_sector_t, const void *,
+                           block_sector_t cnt);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
@@ -61,10 +65,15 @@ void block_print_stats (void);
 
 /* Lower-level interface to block device drivers. */
 
+/* Each operation transfers CNT consecutive sectors starting at
+   the given sector, which the driver should move in as few device
+   requests as it can. */
 struct block_operations
   {
-    void (*read) (void *aux, block_sector_t, void *buffer);
-    void (*write) (void *aux, block_sector_t, const void *buffer);
+    void (*read) (void *aux, block_sector_t, void *buffer,
+                  block_sector_t cnt);
+    void (*write) (void *aux, block_sector_t, const void *buffer,
+                   block_sector_t cnt);
   };
 
 struct block *block_register (const char *name, enum block_type,
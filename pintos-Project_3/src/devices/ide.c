@@ -34,6 +34,7 @@
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +50,16 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+
+/* Most sectors moved by one command: the Sector Count register
+   is 8 bits wide, with 0 meaning 256. */
+#define MAX_TRANSFER_SECTORS 256
+
+/* Largest DRQ block we ask for with SET MULTIPLE MODE. */
+#define MAX_MULTIPLE_SECTORS 16
 
 /* An ATA device. */
 struct ata_disk
@@ -57,6 +68,8 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    int multiple_cnt;           /* Sectors per READ/WRITE MULTIPLE DRQ
+                                   block, or 0 if not in use. */
   };
 
 /* An ATA channel (aka controller).
@@ -84,11 +97,14 @@ static struct block_operations ide_operations;
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
+static void set_multiple_mode (struct ata_disk *, const char *id);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void select_sector (struct ata_disk *, block_sector_t,
+                           block_sector_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
-static void input_sector (struct channel *, void *);
-static void output_sector (struct channel *, const void *);
+static void input_sectors (struct channel *, void *, block_sector_t cnt);
+static void output_sectors (struct channel *, const void *,
+                            block_sector_t cnt);
 
 static void wait_until_idle (const struct ata_disk *);
 static bool wait_while_busy (const struct ata_disk *);
@@ -136,6 +152,7 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->multiple_cnt = 0;
         }
 
       /* Register interrupt handler. */
@@ -279,7 +296,7 @@ identify_ata_device (struct ata_disk *d)
       d->is_ata = false;
       return;
     }
-  input_sector (c, id);
+  input_sectors (c, id, 1);
 
   /* Calculate capacity.
      Read model name and serial number. */
@@ -303,12 +320,43 @@ identify_ata_device (struct ata_disk *d)
       return;
     }
 
+  /* Move several sectors per interrupt when the disk allows. */
+  set_multiple_mode (d, id);
+
   /* Register. */
   block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
                           &ide_operations, d);
   partition_scan (block);
 }
 
+/* Enables READ/WRITE MULTIPLE on disk D, given the IDENTIFY
+   DEVICE response ID.  Word 47 holds the largest number of
+   sectors the disk can move per DRQ block (that is, per
+   interrupt); we use the largest power of 2 up to
+   MAX_MULTIPLE_SECTORS that fits.  Leaves D's multiple_cnt at 0,
+   so that plain READ/WRITE SECTOR is used, if the disk does not
+   support the feature or rejects the command. */
+static void
+set_multiple_mode (struct ata_disk *d, const char *id) 
+{
+  struct channel *c = d->channel;
+  int max_cnt = (uint8_t) id[47 * 2];
+  int cnt;
+
+  for (cnt = MAX_MULTIPLE_SECTORS; cnt > max_cnt; cnt /= 2)
+    continue;
+  if (cnt < 2)
+    return;
+
+  select_device_wait (d);
+  outb (reg_nsect (c), cnt);
+  issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+  sema_down (&c->completion_wait);
+  wait_while_busy (d);
+  if ((inb (reg_status (c)) & STA_ERR) == 0)
+    d->multiple_cnt = cnt;
+}
+
 /* Translates STRING, which consists of SIZE bytes in a funky
    format, into a null-terminated string in-place.  Drops
    trailing whitespace and null bytes.  Returns STRING.  */
@@ -337,42 +385,103 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for BLOCK_SECTOR_SIZE bytes.
+/* Returns the number of sectors that disk D transfers per DRQ
+   block (that is, per interrupt) when LEFT sectors remain in the
+   current command. */
+static block_sector_t
+drq_block_cnt (const struct ata_disk *d, block_sector_t left) 
+{
+  block_sector_t cnt = d->multiple_cnt > 0 ? d->multiple_cnt : 1;
+  return left < cnt ? left : cnt;
+}
+
+/* Reads CNT sectors starting at SEC_NO from disk D into BUFFER,
+   which must have room for CNT * BLOCK_SECTOR_SIZE bytes.  Up to
+   MAX_TRANSFER_SECTORS sectors are moved per command, and up to
+   D's multiple_cnt sectors per interrupt.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_read (void *d_, block_sector_t sec_no, void *buffer)
+ide_read (void *d_, block_sector_t sec_no, void *buffer, block_sector_t cnt)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  uint8_t *p = buffer;
+  uint8_t command = (d->multiple_cnt > 0
+                     ? CMD_READ_MULTIPLE : CMD_READ_SECTOR_RETRY);
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
+  while (cnt > 0) 
+    {
+      block_sector_t xfer_cnt = (cnt < MAX_TRANSFER_SECTORS
+                                 ? cnt : MAX_TRANSFER_SECTORS);
+      block_sector_t left;
+
+      select_sector (d, sec_no, xfer_cnt);
+      issue_pio_command (c, command);
+      for (left = xfer_cnt; left > 0; ) 
+        {
+          block_sector_t block_cnt = drq_block_cnt (d, left);
+
+          sema_down (&c->completion_wait);
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk read failed, sector=%"PRDSNu,
+                   d->name, sec_no + (xfer_cnt - left));
+          input_sectors (c, p, block_cnt);
+          p += block_cnt * BLOCK_SECTOR_SIZE;
+          left -= block_cnt;
+        }
+
+      sec_no += xfer_cnt;
+      cnt -= xfer_cnt;
+    }
   lock_release (&c->lock);
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
+/* Writes CNT sectors starting at SEC_NO to disk D from BUFFER,
+   which must contain CNT * BLOCK_SECTOR_SIZE bytes.  Returns
+   after the disk has acknowledged receiving the data.  Up to
+   MAX_TRANSFER_SECTORS sectors are moved per command, and up to
+   D's multiple_cnt sectors per interrupt.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+ide_write (void *d_, block_sector_t sec_no, const void *buffer,
+           block_sector_t cnt)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  const uint8_t *p = buffer;
+  uint8_t command = (d->multiple_cnt > 0
+                     ? CMD_WRITE_MULTIPLE : CMD_WRITE_SECTOR_RETRY);
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
+  while (cnt > 0) 
+    {
+      block_sector_t xfer_cnt = (cnt < MAX_TRANSFER_SECTORS
+                                 ? cnt : MAX_TRANSFER_SECTORS);
+      block_sector_t left;
+
+      select_sector (d, sec_no, xfer_cnt);
+      issue_pio_command (c, command);
+      for (left = xfer_cnt; left > 0; ) 
+        {
+          block_sector_t block_cnt = drq_block_cnt (d, left);
+
+          /* The disk interrupts after each block, either to ask
+             for the next one or to acknowledge the last. */
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk write failed, sector=%"PRDSNu,
+                   d->name, sec_no + (xfer_cnt - left));
+          output_sectors (c, p, block_cnt);
+          sema_down (&c->completion_wait);
+          p += block_cnt * BLOCK_SECTOR_SIZE;
+          left -= block_cnt;
+        }
+
+      sec_no += xfer_cnt;
+      cnt -= xfer_cnt;
+    }
   lock_release (&c->lock);
 }
 
@@ -381,19 +490,21 @@ static struct block_operations ide_operations =
     ide_read,
     ide_write
   };
-
+
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and CNT to the disk's sector selection
+   registers.  (We use LBA mode.)  CNT must be between 1 and
+   MAX_TRANSFER_SECTORS. */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sector (struct ata_disk *d, block_sector_t sec_no, block_sector_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= MAX_TRANSFER_SECTORS);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt == MAX_TRANSFER_SECTORS ? 0 : cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -414,22 +525,23 @@ issue_pio_command (struct channel *c, uint8_t command)
   outb (reg_command (c), command);
 }
 
-/* Reads a sector from channel C's data register in PIO mode into
-   SECTOR, which must have room for BLOCK_SECTOR_SIZE bytes. */
+/* Reads CNT sectors from channel C's data register in PIO mode
+   into SECTORS, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes. */
 static void
-input_sector (struct channel *c, void *sector) 
+input_sectors (struct channel *c, void *sectors, block_sector_t cnt) 
 {
-  insw (reg_data (c), sector, BLOCK_SECTOR_SIZE / 2);
+  insw (reg_data (c), sectors, cnt * BLOCK_SECTOR_SIZE / 2);
 }
 
-/* Writes SECTOR to channel C's data register in PIO mode.
-   SECTOR must contain BLOCK_SECTOR_SIZE bytes. */
+/* Writes CNT sectors to channel C's data register in PIO mode.
+   SECTORS must contain CNT * BLOCK_SECTOR_SIZE bytes. */
 static void
-output_sector (struct channel *c, const void *sector) 
+output_sectors (struct channel *c, const void *sectors, block_sector_t cnt) 
 {
-  outsw (reg_data (c), sector, BLOCK_SECTOR_SIZE / 2);
+  outsw (reg_data (c), sectors, cnt * BLOCK_SECTOR_SIZE / 2);
 }
-
+
 /* Low-level ATA primitives. */
 
 /* Wait up to 10 seconds for the controller to become idle, that
@@ -298,23 +298,27 @@ partition_type_name (uint8_t type)
   return type_names[type] != NULL ? type_names[type] : "Unknown";
 }
 
-/* Reads sector SECTOR from partition P into BUFFER, which must
-   have room for BLOCK_SECTOR_SIZE bytes. */
+/* Reads CNT sectors starting at SECTOR from partition P into
+   BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes. */
 static void
-partition_read (void *p_, block_sector_t sector, void *buffer)
+partition_read (void *p_, block_sector_t sector, void *buffer,
+                block_sector_t cnt)
 {
   struct partition *p = p_;
-  block_read (p->block, p->start + sector, buffer);
+  block_read_multiple (p->block, p->start + sector, buffer, cnt);
 }
 
-/* Write sector SECTOR to partition P from BUFFER, which must
-   contain BLOCK_SECTOR_SIZE bytes.  Returns after the block has
-   acknowledged receiving the data. */
+/* Write CNT sectors starting at SECTOR to partition P from
+   BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Returns after the block has acknowledged receiving the
+   data. */
 static void
-partition_write (void *p_, block_sector_t sector, const void *buffer)
+partition_write (void *p_, block_sector_t sector, const void *buffer,
+                 block_sector_t cnt)
 {
   struct partition *p = p_;
-  block_write (p->block, p->start + sector, buffer);
+  block_write_multiple (p->block, p->start + sector, buffer, cnt);
 }
 
 static struct block_operations partition_operations =
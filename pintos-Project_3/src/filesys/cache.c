@@ -0,0 +1,352 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Buffer cache of file system sectors.
+
+   Every access to the file system device goes through a fixed
+   table of CACHE_SIZE sectors.  Writes only dirty the cached
+   copy.  Dirty sectors reach the disk when they are evicted,
+   when the write-behind thread flushes the cache every
+   CACHE_FLUSH_TICKS, or when the file system shuts down.
+   Victims are chosen by the clock algorithm.
+
+   cache_lock protects the mapping from sectors to entries and
+   the entries' pin counts, accessed bits, and clock hand.  Each
+   entry also has its own lock, held while its data is read,
+   written, or copied, so that disk I/O on one entry does not
+   hold up hits on the others.  A user buffer may fault, and a
+   fault may read the same sector or kill the process, so user
+   data is copied through a kernel buffer outside the lock. */
+
+/* Number of sectors in the cache. */
+#define CACHE_SIZE 64
+
+/* Timer ticks between write-behind flushes. */
+#define CACHE_FLUSH_TICKS (5 * TIMER_FREQ)
+
+/* Sector number of an unused entry. */
+#define CACHE_FREE ((block_sector_t) -1)
+
+/* A cached sector. */
+struct cache_entry
+  {
+    block_sector_t sector;              /* Cached sector, or CACHE_FREE. */
+    block_sector_t prev_sector;         /* Sector being written back on
+                                           eviction, or CACHE_FREE. */
+    bool accessed;                      /* Used since the clock passed? */
+    bool dirty;                         /* Differs from the disk? */
+    int pin_cnt;                        /* Users waiting for or holding
+                                           LOCK; not evictable. */
+    struct lock lock;                   /* Held while DATA is in use. */
+    uint8_t data[BLOCK_SECTOR_SIZE];    /* Sector contents. */
+  };
+
+static struct cache_entry cache[CACHE_SIZE];
+static struct lock cache_lock;
+static size_t clock_hand;
+
+/* Most read-ahead requests waiting for the read-ahead thread.
+   Requests beyond this are dropped. */
+#define READ_AHEAD_MAX 32
+
+/* Sectors waiting to be read ahead, in a circular queue, and the
+   lock and condition that guard it. */
+static block_sector_t read_ahead_queue[READ_AHEAD_MAX];
+static size_t read_ahead_head, read_ahead_cnt;
+static struct lock read_ahead_lock;
+static struct condition read_ahead_cond;
+
+static thread_func write_behind_daemon NO_RETURN;
+static thread_func read_ahead_daemon NO_RETURN;
+
+/* Initializes the buffer cache and starts the write-behind and
+   read-ahead threads. */
+void
+cache_init (void)
+{
+  size_t i;
+
+  lock_init (&cache_lock);
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      cache[i].sector = CACHE_FREE;
+      cache[i].prev_sector = CACHE_FREE;
+      cache[i].accessed = false;
+      cache[i].dirty = false;
+      cache[i].pin_cnt = 0;
+      lock_init (&cache[i].lock);
+    }
+  lock_init (&read_ahead_lock);
+  cond_init (&read_ahead_cond);
+  thread_create ("cachewb", PRI_DEFAULT, write_behind_daemon, NULL);
+  thread_create ("cachera", PRI_DEFAULT, read_ahead_daemon, NULL);
+}
+
+/* Returns the entry holding SECTOR, or one being written back
+   from SECTOR if PREV is true, or a null pointer.  The caller
+   must hold cache_lock. */
+static struct cache_entry *
+cache_lookup (block_sector_t sector, bool prev)
+{
+  size_t i;
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    if (cache[i].sector == sector || (prev && cache[i].prev_sector == sector))
+      return &cache[i];
+  return NULL;
+}
+
+/* Chooses an entry to hold a new sector using the clock
+   algorithm, passing over entries in use, and returns it with
+   its lock held.  Returns a null pointer if every entry is in
+   use.  The caller must hold cache_lock. */
+static struct cache_entry *
+cache_evict (void)
+{
+  size_t scanned;
+
+  for (scanned = 0; scanned < 2 * CACHE_SIZE; scanned++)
+    {
+      struct cache_entry *e = &cache[clock_hand];
+      clock_hand = (clock_hand + 1) % CACHE_SIZE;
+
+      if (e->pin_cnt > 0 || e->prev_sector != CACHE_FREE)
+        continue;
+      if (e->accessed)
+        {
+          e->accessed = false;
+          continue;
+        }
+      if (lock_try_acquire (&e->lock))
+        return e;
+    }
+  return NULL;
+}
+
+/* Returns the entry for SECTOR with its lock held and pinned,
+   bringing the sector in if it is not cached.  The sector is
+   read from disk unless READ_IN is false, when the caller is
+   about to overwrite all of it. */
+static struct cache_entry *
+cache_get (block_sector_t sector, bool read_in)
+{
+  struct cache_entry *e;
+
+  for (;;)
+    {
+      lock_acquire (&cache_lock);
+      e = cache_lookup (sector, true);
+      if (e != NULL)
+        {
+          bool hit = e->sector == sector;
+
+          /* Wait for whoever is using the entry.  If it is
+             writing SECTOR back on eviction, look again once the
+             write is done. */
+          e->pin_cnt++;
+          lock_release (&cache_lock);
+          lock_acquire (&e->lock);
+          if (hit)
+            {
+              e->accessed = true;
+              return e;
+            }
+          lock_release (&e->lock);
+          lock_acquire (&cache_lock);
+          e->pin_cnt--;
+          lock_release (&cache_lock);
+          continue;
+        }
+
+      e = cache_evict ();
+      if (e == NULL)
+        {
+          /* Every entry is busy.  Let their users finish. */
+          lock_release (&cache_lock);
+          thread_yield ();
+          continue;
+        }
+
+      /* Take over the entry.  Its old sector stays findable
+         through prev_sector until it is on disk, so that no one
+         reads a stale copy of it meanwhile. */
+      if (e->dirty)
+        e->prev_sector = e->sector;
+      e->sector = sector;
+      e->accessed = true;
+      e->pin_cnt++;
+      lock_release (&cache_lock);
+
+      if (e->prev_sector != CACHE_FREE)
+        {
+          block_write (fs_device, e->prev_sector, e->data);
+          e->dirty = false;
+          lock_acquire (&cache_lock);
+          e->prev_sector = CACHE_FREE;
+          lock_release (&cache_lock);
+        }
+      if (read_in)
+        block_read (fs_device, sector, e->data);
+      return e;
+    }
+}
+
+/* Releases entry E obtained from cache_get(), marking it dirty
+   if DIRTY is true. */
+static void
+cache_put (struct cache_entry *e, bool dirty)
+{
+  if (dirty)
+    e->dirty = true;
+  lock_release (&e->lock);
+
+  lock_acquire (&cache_lock);
+  e->pin_cnt--;
+  lock_release (&cache_lock);
+}
+
+/* Reads SIZE bytes of SECTOR, starting at byte SECTOR_OFS, into
+   the user buffer UBUF, through a kernel buffer.  Kept out of
+   line so that the kernel buffer takes no stack in the paths
+   that page faults go through. */
+static void NO_INLINE
+cache_read_user (block_sector_t sector, void *ubuf, int sector_ofs, int size)
+{
+  uint8_t bounce[BLOCK_SECTOR_SIZE];
+
+  cache_read (sector, bounce, sector_ofs, size);
+  memcpy (ubuf, bounce, size);
+}
+
+/* Writes SIZE bytes from the user buffer UBUF into SECTOR,
+   starting at byte SECTOR_OFS, through a kernel buffer. */
+static void NO_INLINE
+cache_write_user (block_sector_t sector, const void *ubuf, int sector_ofs,
+                  int size)
+{
+  uint8_t bounce[BLOCK_SECTOR_SIZE];
+
+  memcpy (bounce, ubuf, size);
+  cache_write (sector, bounce, sector_ofs, size);
+}
+
+/* Reads SIZE bytes of SECTOR, starting at byte SECTOR_OFS, into
+   BUFFER. */
+void
+cache_read (block_sector_t sector, void *buffer, int sector_ofs, int size)
+{
+  struct cache_entry *e;
+
+  ASSERT (sector_ofs >= 0 && size >= 0
+          && sector_ofs + size <= BLOCK_SECTOR_SIZE);
+
+  if (is_user_vaddr (buffer))
+    {
+      cache_read_user (sector, buffer, sector_ofs, size);
+      return;
+    }
+  e = cache_get (sector, true);
+  memcpy (buffer, e->data + sector_ofs, size);
+  cache_put (e, false);
+}
+
+/* Writes SIZE bytes from BUFFER into SECTOR, starting at byte
+   SECTOR_OFS.  The data reaches the disk later. */
+void
+cache_write (block_sector_t sector, const void *buffer, int sector_ofs,
+             int size)
+{
+  struct cache_entry *e;
+
+  ASSERT (sector_ofs >= 0 && size >= 0
+          && sector_ofs + size <= BLOCK_SECTOR_SIZE);
+
+  if (is_user_vaddr (buffer))
+    {
+      cache_write_user (sector, buffer, sector_ofs, size);
+      return;
+    }
+  e = cache_get (sector, size < BLOCK_SECTOR_SIZE);
+  memcpy (e->data + sector_ofs, buffer, size);
+  cache_put (e, true);
+}
+
+/* Writes every dirty cached sector to disk. */
+void
+cache_flush (void)
+{
+  size_t i;
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[i];
+
+      lock_acquire (&e->lock);
+      if (e->dirty && e->sector != CACHE_FREE)
+        {
+          block_write (fs_device, e->sector, e->data);
+          e->dirty = false;
+        }
+      lock_release (&e->lock);
+    }
+}
+
+/* Asks the read-ahead thread to bring SECTOR into the cache, so
+   that a later read of it does not wait for the disk.  Returns
+   at once, dropping the request if too many are waiting. */
+void
+cache_read_ahead (block_sector_t sector)
+{
+  lock_acquire (&read_ahead_lock);
+  if (read_ahead_cnt < READ_AHEAD_MAX)
+    {
+      read_ahead_queue[(read_ahead_head + read_ahead_cnt++) % READ_AHEAD_MAX]
+        = sector;
+      cond_signal (&read_ahead_cond, &read_ahead_lock);
+    }
+  lock_release (&read_ahead_lock);
+}
+
+/* Read-ahead thread.  Reads the sectors queued by
+   cache_read_ahead() that are not cached yet. */
+static void
+read_ahead_daemon (void *aux UNUSED)
+{
+  for (;;)
+    {
+      block_sector_t sector;
+      bool cached;
+
+      lock_acquire (&read_ahead_lock);
+      while (read_ahead_cnt == 0)
+        cond_wait (&read_ahead_cond, &read_ahead_lock);
+      sector = read_ahead_queue[read_ahead_head];
+      read_ahead_head = (read_ahead_head + 1) % READ_AHEAD_MAX;
+      read_ahead_cnt--;
+      lock_release (&read_ahead_lock);
+
+      lock_acquire (&cache_lock);
+      cached = cache_lookup (sector, true) != NULL;
+      lock_release (&cache_lock);
+      if (!cached)
+        cache_put (cache_get (sector, true), false);
+    }
+}
+
+/* Write-behind thread.  Flushes the cache periodically, so that
+   a crash loses at most CACHE_FLUSH_TICKS worth of writes. */
+static void
+write_behind_daemon (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (CACHE_FLUSH_TICKS);
+      cache_flush ();
+    }
+}
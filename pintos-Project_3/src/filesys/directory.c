@@ -1,6 +1,7 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
@@ -21,12 +22,75 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
-/* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+/* Directory formats.
+
+   A linear directory is an array of dir_entry slots, searched
+   from the start.  Directories on disks formatted before hashed
+   directories existed are linear, and are still read and
+   written as such.
+
+   A hashed directory starts with a dir_header, in place of the
+   first slot, followed by a hash table of SLOT_CNT slots with
+   linear probing.  A free slot whose name is empty has never
+   been used and ends a probe; a removed entry keeps its name, so
+   probes go on past it, and it may be reused.  When more than
+   3/4 of the slots have been used, the table is rebuilt, doubling
+   if at least half of the slots are in use. */
+
+/* Identifies a hashed directory.  Lies where a linear
+   directory's first inode_sector would, and is larger than any
+   sector number. */
+#define DIR_HASH_MAGIC 0xd1a5ba5e
+
+/* Header of a hashed directory.  Must be the size of a
+   dir_entry. */
+struct dir_header
+  {
+    uint32_t magic;                     /* DIR_HASH_MAGIC. */
+    uint32_t slot_cnt;                  /* Slots in the hash table. */
+    uint32_t fill_cnt;                  /* Slots used, including removed. */
+    uint8_t unused[sizeof (struct dir_entry) - 3 * sizeof (uint32_t)];
+  };
+
+/* Byte offset of slot IDX of a hashed directory. */
+static off_t
+slot_ofs (size_t idx) 
+{
+  return sizeof (struct dir_header) + idx * sizeof (struct dir_entry);
+}
+
+/* Reads the header of DIR into *H.  Returns true if DIR is a
+   hashed directory, false if it is linear. */
+static bool
+read_header (const struct dir *dir, struct dir_header *h) 
+{
+  return (inode_read_at (dir->inode, h, sizeof *h, 0) == sizeof *h
+          && h->magic == DIR_HASH_MAGIC);
+}
+
+/* Creates a hashed directory with space for ENTRY_CNT entries in
+   the given SECTOR.  Returns true if successful, false on
+   failure. */
 bool
 dir_create (block_sector_t sector, size_t entry_cnt)
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  struct dir_header h;
+  struct inode *inode;
+  bool success;
+
+  ASSERT (sizeof h == sizeof (struct dir_entry));
+
+  memset (&h, 0, sizeof h);
+  h.magic = DIR_HASH_MAGIC;
+  h.slot_cnt = entry_cnt * 2 > 16 ? entry_cnt * 2 : 16;
+  if (!inode_create (sector, slot_ofs (h.slot_cnt)))
+    return false;
+
+  inode = inode_open (sector);
+  success = (inode != NULL
+             && inode_write_at (inode, &h, sizeof h, 0) == sizeof h);
+  inode_close (inode);
+  return success;
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -83,6 +147,47 @@ dir_get_inode (struct dir *dir)
   return dir->inode;
 }
 
+/* Probes the hash table of hashed directory DIR, whose header
+   is H, for NAME.  If an entry for NAME is in use, returns true
+   and sets *EP to it and *OFSP to its byte offset.  Otherwise,
+   returns false and sets *OFSP to the offset of the first free
+   slot on NAME's probe sequence and *FRESHP to true if that slot
+   has never been used, or sets *OFSP to -1 if there is no free
+   slot. */
+static bool
+probe (const struct dir *dir, const struct dir_header *h, const char *name,
+       struct dir_entry *ep, off_t *ofsp, bool *freshp) 
+{
+  unsigned hash = hash_string (name);
+  bool have_free = false;
+  size_t i;
+
+  *ofsp = -1;
+  for (i = 0; i < h->slot_cnt; i++) 
+    {
+      off_t ofs = slot_ofs ((hash + i) % h->slot_cnt);
+      struct dir_entry e;
+
+      if (inode_read_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+        break;
+      if (e.in_use && !strcmp (name, e.name)) 
+        {
+          *ep = e;
+          *ofsp = ofs;
+          return true;
+        }
+      if (!e.in_use && !have_free)
+        {
+          have_free = true;
+          *ofsp = ofs;
+          *freshp = e.name[0] == '\0';
+        }
+      if (!e.in_use && e.name[0] == '\0')
+        break;
+    }
+  return false;
+}
+
 /* Searches DIR for a file with the given NAME.
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
@@ -92,12 +197,27 @@ static bool
 lookup (const struct dir *dir, const char *name,
         struct dir_entry *ep, off_t *ofsp) 
 {
+  struct dir_header h;
   struct dir_entry e;
   size_t ofs;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  if (read_header (dir, &h))
+    {
+      off_t slot;
+      bool fresh;
+
+      if (!probe (dir, &h, name, &e, &slot, &fresh))
+        return false;
+      if (ep != NULL)
+        *ep = e;
+      if (ofsp != NULL)
+        *ofsp = slot;
+      return true;
+    }
+
   for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
        ofs += sizeof e) 
     if (e.in_use && !strcmp (name, e.name)) 
@@ -132,6 +252,107 @@ dir_lookup (const struct dir *dir, const char *name,
   return *inode != NULL;
 }
 
+/* Rebuilds the hash table of hashed directory DIR, whose header
+   is *H, dropping removed entries, doubling its size if at least
+   half of its slots are in use.  Updates *H.  Returns true if
+   successful, false if memory or disk space runs out. */
+static bool
+rehash (struct dir *dir, struct dir_header *h) 
+{
+  struct dir_entry *old, *new;
+  size_t old_cnt = h->slot_cnt, new_cnt, used_cnt = 0, i;
+  off_t old_size = old_cnt * sizeof *old;
+  off_t new_size;
+  bool success = false;
+
+  old = malloc (old_size);
+  if (old == NULL)
+    return false;
+  if (inode_read_at (dir->inode, old, old_size, slot_ofs (0)) != old_size)
+    goto done;
+  for (i = 0; i < old_cnt; i++)
+    if (old[i].in_use)
+      used_cnt++;
+
+  new_cnt = used_cnt + 1 > old_cnt / 2 ? old_cnt * 2 : old_cnt;
+  new_size = new_cnt * sizeof *new;
+  new = calloc (new_cnt, sizeof *new);
+  if (new == NULL)
+    goto done;
+  for (i = 0; i < old_cnt; i++)
+    if (old[i].in_use)
+      {
+        size_t idx = hash_string (old[i].name) % new_cnt;
+        while (new[idx].in_use)
+          idx = (idx + 1) % new_cnt;
+        new[idx] = old[i];
+      }
+
+  /* The new table overwrites the old one in place.  Extend the
+     directory to its full size first, so that running out of disk
+     space leaves the old table untouched instead of half
+     overwritten. */
+  if (slot_ofs (new_cnt) > inode_length (dir->inode))
+    {
+      char zero = 0;
+      if (inode_write_at (dir->inode, &zero, 1, slot_ofs (new_cnt) - 1) != 1)
+        {
+          free (new);
+          goto done;
+        }
+    }
+  if (inode_write_at (dir->inode, new, new_size, slot_ofs (0)) == new_size)
+    {
+      h->slot_cnt = new_cnt;
+      h->fill_cnt = used_cnt;
+      success = inode_write_at (dir->inode, h, sizeof *h, 0) == sizeof *h;
+    }
+  free (new);
+
+ done:
+  free (old);
+  return success;
+}
+
+/* Adds NAME, whose inode is in INODE_SECTOR, to hashed directory
+   DIR, whose header is *H.  Returns true if successful, false if
+   NAME is in use or a disk or memory error occurs. */
+static bool
+hashed_add (struct dir *dir, struct dir_header *h, const char *name,
+            block_sector_t inode_sector) 
+{
+  struct dir_entry e;
+  off_t ofs;
+  bool fresh;
+
+  if (probe (dir, h, name, &e, &ofs, &fresh))
+    return false;
+
+  /* Keep a quarter of the slots never used, so probes stay
+     short. */
+  if (ofs == -1 || (fresh && (h->fill_cnt + 1) * 4 > h->slot_cnt * 3))
+    {
+      if (!rehash (dir, h))
+        return false;
+      probe (dir, h, name, &e, &ofs, &fresh);
+      if (ofs == -1)
+        return false;
+    }
+
+  if (fresh)
+    {
+      h->fill_cnt++;
+      if (inode_write_at (dir->inode, h, sizeof *h, 0) != sizeof *h)
+        return false;
+    }
+
+  memset (&e, 0, sizeof e);
+  e.in_use = true;
+  strlcpy (e.name, name, sizeof e.name);
+  e.inode_sector = inode_sector;
+  return inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+}
+
 /* Adds a file named NAME to DIR, which must not already contain a
    file by that name.  The file's inode is in sector
    INODE_SECTOR.
@@ -141,6 +362,7 @@ dir_lookup (const struct dir *dir, const char *name,
 bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
+  struct dir_header h;
   struct dir_entry e;
   off_t ofs;
   bool success = false;
@@ -152,6 +374,9 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   if (*name == '\0' || strlen (name) > NAME_MAX)
     return false;
 
+  if (read_header (dir, &h))
+    return hashed_add (dir, &h, name, inode_sector);
+
   /* Check that NAME is not in use. */
   if (lookup (dir, name, NULL, NULL))
     goto done;
@@ -221,8 +446,14 @@ dir_remove (struct dir *dir, const char *name)
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
+  struct dir_header h;
   struct dir_entry e;
 
+  /* Skip the header of a hashed directory.  Its slots are read in
+     table order. */
+  if (dir->pos == 0 && read_header (dir, &h))
+    dir->pos = slot_ofs (0);
+
   while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
     {
       dir->pos += sizeof e;
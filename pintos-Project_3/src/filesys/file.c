@@ -3,12 +3,17 @@
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 
+/* Bytes past the end of a sequential read to read ahead. */
+#define READ_AHEAD_BYTES (8 * BLOCK_SECTOR_SIZE)
+
 /* An open file. */
 struct file 
   {
     struct inode *inode;        /* File's inode. */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
+    off_t seq_end;              /* Position after the last file_read(). */
+    off_t ra_end;               /* End of data already read ahead. */
   };
 
 /* Opens a file for the given INODE, of which it takes ownership,
@@ -23,6 +28,8 @@ file_open (struct inode *inode)
       file->inode = inode;
       file->pos = 0;
       file->deny_write = false;
+      file->seq_end = 0;
+      file->ra_end = 0;
       return file;
     }
   else
@@ -64,12 +71,28 @@ file_get_inode (struct file *file)
    starting at the file's current position.
    Returns the number of bytes actually read,
    which may be less than SIZE if end of file is reached.
-   Advances FILE's position by the number of bytes read. */
+   Advances FILE's position by the number of bytes read.
+   A read that picks up where the previous one left off starts
+   reading the data after it ahead. */
 off_t
 file_read (struct file *file, void *buffer, off_t size) 
 {
+  bool sequential = file->pos == file->seq_end;
   off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
   file->pos += bytes_read;
+  file->seq_end = file->pos;
+
+  if (sequential && bytes_read > 0)
+    {
+      /* Skip what earlier read-ahead already asked for. */
+      off_t start = file->ra_end > file->pos ? file->ra_end : file->pos;
+      off_t end = file->pos + READ_AHEAD_BYTES;
+      if (start < end)
+        {
+          inode_read_ahead (file->inode, end - start, start);
+          file->ra_end = end;
+        }
+    }
   return bytes_read;
 }
 
@@ -149,12 +172,18 @@ file_length (struct file *file)
 }
 
 /* Sets the current position in FILE to NEW_POS bytes from the
-   start of the file. */
+   start of the file.  Reading on from a new position counts as
+   sequential, with read-ahead starting afresh from there. */
 void
 file_seek (struct file *file, off_t new_pos)
 {
   ASSERT (file != NULL);
   ASSERT (new_pos >= 0);
+  if (new_pos != file->pos)
+    {
+      file->seq_end = new_pos;
+      file->ra_end = new_pos;
+    }
   file->pos = new_pos;
 }
 
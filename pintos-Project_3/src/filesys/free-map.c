@@ -1,12 +1,272 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <rbtree.h>
+#include <string.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/malloc.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
+static block_sector_t alloc_hint;    /* Sector after the last allocation. */
+static bool free_map_dirty;          /* Changed since last written? */
+
+/* Free extents.
+
+   The bitmap is the free map as it is kept on disk.  In memory,
+   the runs of free sectors it holds are also indexed twice, by
+   first sector and by length, in two red-black trees, so that
+   allocation finds a run without scanning the bitmap: the run
+   holding a goal sector, the first run after it, and the
+   smallest run of at least a given length each take O(lg n)
+   time in the number of runs.  Releasing sectors merges them
+   with the runs on either side.
+
+   An extent is allocated with malloc().  If that fails, the run
+   is left out of the index: its sectors stay free in the bitmap
+   and become usable again when the index is rebuilt from the
+   bitmap at the next boot.  So every indexed extent is free,
+   though not every free sector need be indexed. */
+struct extent
+  {
+    block_sector_t start;               /* First sector. */
+    size_t length;                      /* Number of sectors. */
+    struct rb_elem start_elem;          /* Element in extents_by_start. */
+    struct rb_elem size_elem;           /* Element in extents_by_size. */
+  };
+
+static struct rb_tree extents_by_start;  /* Ordered by start. */
+static struct rb_tree extents_by_size;   /* Ordered by length, then start. */
+
+/* Orders extents by first sector. */
+static bool
+extent_start_less (const struct rb_elem *a_, const struct rb_elem *b_,
+                   void *aux UNUSED)
+{
+  const struct extent *a = rb_entry (a_, struct extent, start_elem);
+  const struct extent *b = rb_entry (b_, struct extent, start_elem);
+
+  return a->start < b->start;
+}
+
+/* Orders extents by length, and extents of equal length by first
+   sector, so that the best fit for a request is also the one
+   closest to the start of the disk. */
+static bool
+extent_size_less (const struct rb_elem *a_, const struct rb_elem *b_,
+                  void *aux UNUSED)
+{
+  const struct extent *a = rb_entry (a_, struct extent, size_elem);
+  const struct extent *b = rb_entry (b_, struct extent, size_elem);
+
+  if (a->length != b->length)
+    return a->length < b->length;
+  return a->start < b->start;
+}
+
+/* Returns the extent that starts at or before SECTOR, nearest
+   to it, or a null pointer if there is none. */
+static struct extent *
+extent_floor (block_sector_t sector)
+{
+  struct extent key;
+  struct rb_elem *e;
+
+  memset (&key, 0, sizeof key);
+  key.start = sector;
+  e = rb_floor (&extents_by_start, &key.start_elem);
+  return e != NULL ? rb_entry (e, struct extent, start_elem) : NULL;
+}
+
+/* Returns the extent that starts at or after SECTOR, nearest to
+   it, or a null pointer if there is none. */
+static struct extent *
+extent_ceiling (block_sector_t sector)
+{
+  struct extent key;
+  struct rb_elem *e;
+
+  memset (&key, 0, sizeof key);
+  key.start = sector;
+  e = rb_lower_bound (&extents_by_start, &key.start_elem);
+  return e != NULL ? rb_entry (e, struct extent, start_elem) : NULL;
+}
+
+/* Returns the smallest extent of at least LENGTH sectors, or the
+   largest extent if none is that long, or a null pointer if
+   there are no extents. */
+static struct extent *
+extent_best_fit (size_t length)
+{
+  struct extent key;
+  struct rb_elem *e;
+
+  memset (&key, 0, sizeof key);
+  key.length = length;
+  e = rb_lower_bound (&extents_by_size, &key.size_elem);
+  if (e == NULL)
+    e = rb_max (&extents_by_size);
+  return e != NULL ? rb_entry (e, struct extent, size_elem) : NULL;
+}
+
+/* Adds the free run of LENGTH sectors at START to the index.  The
+   run must not touch another indexed extent. */
+static void
+extent_insert (block_sector_t start, size_t length)
+{
+  struct extent *e = malloc (sizeof *e);
+
+  if (e == NULL)
+    return;
+  e->start = start;
+  e->length = length;
+  rb_insert (&extents_by_start, &e->start_elem);
+  rb_insert (&extents_by_size, &e->size_elem);
+}
+
+/* Removes E from the index and frees it. */
+static void
+extent_remove (struct extent *e)
+{
+  rb_remove (&extents_by_start, &e->start_elem);
+  rb_remove (&extents_by_size, &e->size_elem);
+  free (e);
+}
+
+/* Makes E cover the LENGTH sectors at START.  The new run must
+   overlap the old one or lie next to it without reaching another
+   extent, so E keeps its place in extents_by_start; only its
+   place by size changes. */
+static void
+extent_resize (struct extent *e, block_sector_t start, size_t length)
+{
+  rb_remove (&extents_by_size, &e->size_elem);
+  e->start = start;
+  e->length = length;
+  rb_insert (&extents_by_size, &e->size_elem);
+}
+
+/* Takes the CNT sectors at SECTOR, which must lie within E, out
+   of E, splitting E in two if they are in its middle. */
+static void
+extent_take (struct extent *e, block_sector_t sector, size_t cnt)
+{
+  block_sector_t end = e->start + e->length;
+
+  ASSERT (sector >= e->start && sector + cnt <= end);
+
+  if (cnt == e->length)
+    extent_remove (e);
+  else if (sector == e->start)
+    extent_resize (e, sector + cnt, e->length - cnt);
+  else
+    {
+      extent_resize (e, e->start, sector - e->start);
+      if (sector + cnt < end)
+        extent_insert (sector + cnt, end - (sector + cnt));
+    }
+}
+
+/* Allocates up to CNT consecutive sectors, or exactly CNT if
+   PARTIAL is false, marking them in the bitmap, and stores the
+   first into *SECTORP.  The sectors are taken, in order of
+   preference, at GOAL if it is free, from the start of the first
+   extent after GOAL if it holds CNT sectors, from the smallest
+   extent that holds CNT sectors, or from the largest extent if
+   PARTIAL allows a shorter run.  Returns the number of sectors
+   allocated, or 0 on failure. */
+static size_t
+extent_alloc (block_sector_t goal, size_t cnt, bool partial,
+              block_sector_t *sectorp)
+{
+  struct extent *e;
+  block_sector_t sector;
+  size_t len;
+
+  ASSERT (cnt > 0);
+
+  e = extent_floor (goal);
+  if (e != NULL && goal < e->start + e->length
+      && (partial || e->start + e->length - goal >= cnt))
+    sector = goal;
+  else
+    {
+      e = extent_ceiling (goal);
+      if (e == NULL || e->length < cnt)
+        e = extent_best_fit (cnt);
+      if (e == NULL || (!partial && e->length < cnt))
+        return 0;
+      sector = e->start;
+    }
+
+  len = e->start + e->length - sector;
+  if (len > cnt)
+    len = cnt;
+  extent_take (e, sector, len);
+  bitmap_set_multiple (free_map, sector, len, true);
+  alloc_hint = sector + len;
+  *sectorp = sector;
+  return len;
+}
+
+/* Marks the CNT sectors at SECTOR free in the bitmap and returns
+   them to the index, merged with the extents on either side. */
+static void
+extent_free (block_sector_t sector, size_t cnt)
+{
+  struct extent *prev, *next;
+  struct rb_elem *e;
+
+  bitmap_set_multiple (free_map, sector, cnt, false);
+
+  prev = extent_floor (sector);
+  if (prev != NULL)
+    e = rb_next (&prev->start_elem);
+  else
+    e = rb_min (&extents_by_start);
+  next = e != NULL ? rb_entry (e, struct extent, start_elem) : NULL;
+  if (prev != NULL && prev->start + prev->length != sector)
+    prev = NULL;
+  if (next != NULL && next->start != sector + cnt)
+    next = NULL;
+
+  if (prev != NULL && next != NULL)
+    {
+      size_t length = prev->length + cnt + next->length;
+      extent_remove (next);
+      extent_resize (prev, prev->start, length);
+    }
+  else if (prev != NULL)
+    extent_resize (prev, prev->start, prev->length + cnt);
+  else if (next != NULL)
+    extent_resize (next, sector, cnt + next->length);
+  else
+    extent_insert (sector, cnt);
+}
+
+/* Rebuilds the index from the bitmap. */
+static void
+extents_rebuild (void)
+{
+  size_t size = bitmap_size (free_map);
+  size_t start = 0;
+
+  while (!rb_empty (&extents_by_start))
+    extent_remove (rb_entry (rb_min (&extents_by_start),
+                             struct extent, start_elem));
+
+  while (start < size
+         && (start = bitmap_scan (free_map, start, 1, false)) != BITMAP_ERROR)
+    {
+      size_t end = bitmap_scan (free_map, start, 1, true);
+      if (end == BITMAP_ERROR)
+        end = size;
+      extent_insert (start, end - start);
+      start = end;
+    }
+}
 
 /* Initializes the free map. */
 void
@@ -17,27 +277,64 @@ free_map_init (void)
     PANIC ("bitmap creation failed--file system device is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  rb_init (&extents_by_start, extent_start_less, NULL);
+  rb_init (&extents_by_size, extent_size_less, NULL);
+  extents_rebuild ();
+}
+
+/* Allocates up to CNT consecutive sectors from the free map,
+   at GOAL if it is free, or else from another run of free
+   sectors, and stores the first into *SECTORP.  Runs of CNT
+   sectors are preferred to shorter ones, and the search takes
+   O(lg n) time in the number of free runs; see extent_alloc().
+   Returns the number of sectors allocated, which is less than
+   CNT if no run of free sectors is that long, or 0 if the disk
+   is full.  The free map is not written; the caller must call
+   free_map_sync() once it is done allocating. */
+size_t
+free_map_allocate_run (block_sector_t goal, size_t cnt,
+                       block_sector_t *sectorp)
+{
+  size_t len = extent_alloc (goal, cnt, true, sectorp);
+
+  if (len > 0)
+    free_map_dirty = true;
+  return len;
+}
+
+/* Writes the free map to disk if free_map_allocate_run() changed
+   it since it was last written. */
+void
+free_map_sync (void)
+{
+  if (free_map_dirty && free_map_file != NULL)
+    {
+      bitmap_write (free_map, free_map_file);
+      free_map_dirty = false;
+    }
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
-   the first into *SECTORP.
+   the first into *SECTORP.  The sectors are taken where the
+   previous allocation ended if they are free there, or else
+   from the best-fitting run of free sectors.
    Returns true if successful, false if not enough consecutive
    sectors were available or if the free_map file could not be
    written. */
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  block_sector_t sector;
+
+  if (extent_alloc (alloc_hint, cnt, false, &sector) == 0)
+    return false;
+  if (free_map_file != NULL && !bitmap_write (free_map, free_map_file))
     {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
+      extent_free (sector, cnt);
+      return false;
     }
-  if (sector != BITMAP_ERROR)
-    *sectorp = sector;
-  return sector != BITMAP_ERROR;
+  *sectorp = sector;
+  return true;
 }
 
 /* Makes CNT sectors starting at SECTOR available for use. */
@@ -45,7 +342,7 @@ void
 free_map_release (block_sector_t sector, size_t cnt)
 {
   ASSERT (bitmap_all (free_map, sector, cnt));
-  bitmap_set_multiple (free_map, sector, cnt, false);
+  extent_free (sector, cnt);
   bitmap_write (free_map, free_map_file);
 }
 
@@ -58,6 +355,7 @@ free_map_open (void)
     PANIC ("can't open free map");
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+  extents_rebuild ();
 }
 
 /* Writes the free map to disk and closes the free map file. */
@@ -3,21 +3,41 @@
 #include <debug.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#ifdef VM
+#include "vm/file.h"
+#endif
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Number of data sectors an inode points to directly. */
+#define DIRECT_CNT 124
+
+/* Number of sector numbers in an index sector. */
+#define INDEX_CNT (BLOCK_SECTOR_SIZE / sizeof (block_sector_t))
+
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+
+   The data sectors are found through a multilevel index.  The
+   first DIRECT_CNT are listed in the inode itself, the next
+   INDEX_CNT in the indirect sector, and the next INDEX_CNT *
+   INDEX_CNT in the index sectors listed in the doubly indirect
+   sector.  Sector 0 holds the free map's inode, so 0 marks an
+   entry that points nowhere yet. */
 struct inode_disk
   {
-    block_sector_t start;               /* First data sector. */
+    block_sector_t direct[DIRECT_CNT];  /* Direct data sectors. */
+    block_sector_t indirect;            /* Index sector of data sectors. */
+    block_sector_t doubly_indirect;     /* Index sector of index sectors. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
   };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -37,20 +57,299 @@ struct inode
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
     struct inode_disk data;             /* Inode content. */
+    struct list extents;                /* Runs of data sectors found so
+                                           far, by position in file. */
+    struct lock extent_lock;            /* Guards extents. */
+#ifdef VM
+    struct list pages;                  /* Pages of this inode in the
+                                           shared page table. */
+#endif
+  };
+
+/* A run of a file's data sectors that lie consecutively on disk.
+
+   Each open inode keeps a list of the runs of its data that have
+   been looked up, so that finding the sector of a byte does not
+   walk the index sectors through the buffer cache again.  Since
+   files are laid out contiguously, a file has few runs, and
+   consecutive sectors found in turn merge into one.  The list
+   only caches the index: a data sector does not move once it is
+   allocated, so an entry never goes stale. */
+struct inode_extent
+  {
+    struct list_elem elem;              /* Element in inode's extents. */
+    size_t idx;                         /* First data sector index. */
+    block_sector_t sector;              /* Disk sector of data sector
+                                           IDX. */
+    size_t cnt;                         /* Number of sectors. */
   };
 
+/* Sectors reserved in the free map for an extension of a file,
+   handed out in order.  Taking them a run at a time lays the file
+   out contiguously and leaves the free map to be written once,
+   after the extension. */
+struct sector_run
+  {
+    block_sector_t next;                /* Next sector to hand out. */
+    size_t left;                        /* Sectors left in the run. */
+    size_t want;                        /* Sectors still needed, at
+                                           least. */
+  };
+
+/* Takes the next sector of RUN into *SECTORP, first reserving a
+   new run of up to RUN->want sectors as close after RUN->next as
+   possible if RUN is used up.  Returns false if the disk is
+   full. */
+static bool
+run_take (struct sector_run *run, block_sector_t *sectorp) 
+{
+  if (run->left == 0)
+    {
+      size_t want = run->want > 0 ? run->want : 1;
+      run->left = free_map_allocate_run (run->next, want, &run->next);
+      if (run->left == 0)
+        return false;
+    }
+  *sectorp = run->next++;
+  run->left--;
+  if (run->want > 0)
+    run->want--;
+  return true;
+}
+
+/* Allocates a sector filled with zeros from RUN and stores it
+   into *SECTOR, unless *SECTOR already points somewhere or RUN is
+   a null pointer.  Returns *SECTOR, which is 0 if allocation
+   fails. */
+static block_sector_t
+index_slot (block_sector_t *sector, struct sector_run *run) 
+{
+  static char zeros[BLOCK_SECTOR_SIZE];
+
+  if (*sector == 0 && run != NULL && run_take (run, sector))
+    cache_write (*sector, zeros, 0, BLOCK_SECTOR_SIZE);
+  return *sector;
+}
+
+/* Returns entry IDX of index sector INDEX, first allocating a
+   sector filled with zeros for it from RUN if it points nowhere
+   and RUN is non-null.  Returns 0 if the entry points
+   nowhere. */
+static block_sector_t
+index_entry (block_sector_t index, size_t idx, struct sector_run *run) 
+{
+  block_sector_t sector;
+  size_t ofs = idx * sizeof sector;
+
+  cache_read (index, &sector, ofs, sizeof sector);
+  if (sector == 0 && run != NULL && index_slot (&sector, run) != 0)
+    cache_write (index, &sector, ofs, sizeof sector);
+  return sector;
+}
+
+/* Returns the sector holding data sector IDX of DISK, allocating
+   it and any index sectors on the way from RUN if RUN is
+   non-null.  Index entries in DISK itself are updated in memory
+   only.  Returns 0 if the sector is not allocated or allocation
+   fails. */
+static block_sector_t
+index_to_sector (struct inode_disk *disk, size_t idx, struct sector_run *run) 
+{
+  block_sector_t index;
+
+  if (idx < DIRECT_CNT)
+    return index_slot (&disk->direct[idx], run);
+  idx -= DIRECT_CNT;
+
+  if (idx < INDEX_CNT)
+    {
+      index = index_slot (&disk->indirect, run);
+      return index != 0 ? index_entry (index, idx, run) : 0;
+    }
+  idx -= INDEX_CNT;
+
+  if (idx < INDEX_CNT * INDEX_CNT)
+    {
+      index = index_slot (&disk->doubly_indirect, run);
+      if (index != 0)
+        index = index_entry (index, idx / INDEX_CNT, run);
+      return index != 0 ? index_entry (index, idx % INDEX_CNT, run) : 0;
+    }
+  return 0;
+}
+
+/* Allocates the data sectors DISK, the inode at SECTOR, needs to
+   be LENGTH bytes long, filled with zeros, without changing its
+   length.  The sectors are reserved in runs, starting right after
+   the file's last sector, or after the inode for an empty file,
+   so that files are laid out contiguously and read sequentially,
+   and the free map is written once at the end.  Returns true if
+   successful, false if the disk is full or LENGTH exceeds the
+   largest file size.  Sectors allocated before a failure stay in
+   the index and are used by the next extension. */
+static bool
+inode_extend (struct inode_disk *disk, block_sector_t sector, off_t length) 
+{
+  size_t idx = bytes_to_sectors (disk->length);
+  size_t end = bytes_to_sectors (length);
+  struct sector_run run;
+  bool success = true;
+
+  run.next = sector + 1;
+  run.left = 0;
+  if (idx > 0)
+    run.next = index_to_sector (disk, idx - 1, NULL) + 1;
+  for (; idx < end; idx++)
+    {
+      run.want = end - idx;
+      if (index_to_sector (disk, idx, &run) == 0)
+        {
+          success = false;
+          break;
+        }
+    }
+  ASSERT (run.left == 0);
+  free_map_sync ();
+  return success;
+}
+
+/* Releases the sectors of index sector INDEX, LEVELS levels
+   above the data sectors, and everything below them. */
+static void
+release_index (block_sector_t index, int levels) 
+{
+  size_t idx;
+
+  if (index == 0)
+    return;
+  if (levels > 0)
+    for (idx = 0; idx < INDEX_CNT; idx++)
+      release_index (index_entry (index, idx, NULL), levels - 1);
+  free_map_release (index, 1);
+}
+
+/* Releases all the data and index sectors of DISK. */
+static void
+inode_release (struct inode_disk *disk) 
+{
+  size_t idx;
+
+  for (idx = 0; idx < DIRECT_CNT; idx++)
+    release_index (disk->direct[idx], 0);
+  release_index (disk->indirect, 1);
+  release_index (disk->doubly_indirect, 2);
+}
+
+/* Returns the disk sector of data sector IDX of INODE if one of
+   INODE's extents covers it, or 0 otherwise. */
+static block_sector_t
+extent_lookup (struct inode *inode, size_t idx) 
+{
+  block_sector_t sector = 0;
+  struct list_elem *e;
+
+  lock_acquire (&inode->extent_lock);
+  for (e = list_begin (&inode->extents); e != list_end (&inode->extents);
+       e = list_next (e)) 
+    {
+      struct inode_extent *x = list_entry (e, struct inode_extent, elem);
+      if (idx < x->idx)
+        break;
+      if (idx < x->idx + x->cnt)
+        {
+          sector = x->sector + (idx - x->idx);
+          break;
+        }
+    }
+  lock_release (&inode->extent_lock);
+  return sector;
+}
+
+/* Records in INODE's extents that data sector IDX is on disk
+   sector SECTOR, growing the extent before or after it if SECTOR
+   continues it, and joining the two if it fills the gap between
+   them.  If memory for a new extent cannot be had, the sector is
+   simply not recorded. */
+static void
+extent_note (struct inode *inode, size_t idx, block_sector_t sector) 
+{
+  struct inode_extent *prev = NULL, *next = NULL;
+  struct list_elem *e;
+
+  lock_acquire (&inode->extent_lock);
+  for (e = list_begin (&inode->extents); e != list_end (&inode->extents);
+       e = list_next (e)) 
+    {
+      struct inode_extent *x = list_entry (e, struct inode_extent, elem);
+      if (x->idx > idx)
+        {
+          next = x;
+          break;
+        }
+      prev = x;
+    }
+
+  /* Another thread may have recorded the sector meanwhile. */
+  if (prev != NULL && idx < prev->idx + prev->cnt)
+    {
+      lock_release (&inode->extent_lock);
+      return;
+    }
+
+  if (prev != NULL && prev->idx + prev->cnt == idx
+           && prev->sector + prev->cnt == sector)
+    {
+      prev->cnt++;
+      if (next != NULL && next->idx == idx + 1 && next->sector == sector + 1)
+        {
+          prev->cnt += next->cnt;
+          list_remove (&next->elem);
+          free (next);
+        }
+    }
+  else if (next != NULL && next->idx == idx + 1 && next->sector == sector + 1)
+    {
+      next->idx--;
+      next->sector--;
+      next->cnt++;
+    }
+  else 
+    {
+      struct inode_extent *x = malloc (sizeof *x);
+      if (x != NULL)
+        {
+          x->idx = idx;
+          x->sector = sector;
+          x->cnt = 1;
+          list_insert (e, &x->elem);
+        }
+    }
+  lock_release (&inode->extent_lock);
+}
+
 /* Returns the block device sector that contains byte offset POS
-   within INODE.
+   within INODE, from INODE's extents if they cover it or else
+   from its index.
    Returns -1 if INODE does not contain data for a byte at offset
    POS. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+byte_to_sector (struct inode *inode, off_t pos) 
 {
+  size_t idx = pos / BLOCK_SECTOR_SIZE;
+  block_sector_t sector;
+
   ASSERT (inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
-  else
+  if (pos >= inode->data.length)
     return -1;
+
+  sector = extent_lookup (inode, idx);
+  if (sector == 0)
+    {
+      sector = index_to_sector (&inode->data, idx, NULL);
+      if (sector != 0)
+        extent_note (inode, idx, sector);
+    }
+  return sector;
 }
 
 /* List of open inodes, so that opening a single inode twice
@@ -84,22 +383,15 @@ inode_create (block_sector_t sector, off_t length)
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
     {
-      size_t sectors = bytes_to_sectors (length);
-      disk_inode->length = length;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
+      if (inode_extend (disk_inode, sector, length)) 
         {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
-            }
+          disk_inode->length = length;
+          cache_write (sector, disk_inode, 0, BLOCK_SECTOR_SIZE);
           success = true; 
         } 
+      else
+        inode_release (disk_inode);
       free (disk_inode);
     }
   return success;
@@ -137,7 +429,12 @@ inode_open (block_sector_t sector)
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  list_init (&inode->extents);
+  lock_init (&inode->extent_lock);
+#ifdef VM
+  list_init (&inode->pages);
+#endif
+  cache_read (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
   return inode;
 }
 
@@ -150,6 +447,16 @@ inode_reopen (struct inode *inode)
   return inode;
 }
 
+#ifdef VM
+/* Returns the list of INODE's pages in the shared page table, which
+   the VM system keeps under its own lock. */
+struct list *
+inode_pages (struct inode *inode)
+{
+  return &inode->pages;
+}
+#endif
+
 /* Returns INODE's inode number. */
 block_sector_t
 inode_get_inumber (const struct inode *inode)
@@ -172,15 +479,20 @@ inode_close (struct inode *inode)
     {
       /* Remove from inode list and release lock. */
       list_remove (&inode->elem);
+#ifdef VM
+      page_cache_drop (inode);
+#endif
  
       /* Deallocate blocks if removed. */
       if (inode->removed) 
         {
           free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          inode_release (&inode->data);
         }
 
+      while (!list_empty (&inode->extents))
+        free (list_entry (list_pop_front (&inode->extents),
+                          struct inode_extent, elem));
       free (inode); 
     }
 }
@@ -194,15 +506,15 @@ inode_remove (struct inode *inode)
   inode->removed = true;
 }
 
-/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
+/* Reads SIZE bytes from INODE into BUFFER, starting at position
+   OFFSET, through the buffer cache but bypassing the page cache.
    Returns the number of bytes actually read, which may be less
-   than SIZE if an error occurs or end of file is reached. */
-off_t
-inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) 
+   than SIZE if end of file is reached. */
+static off_t
+inode_read_direct (struct inode *inode, void *buffer_, off_t size, off_t offset) 
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
 
   while (size > 0) 
     {
@@ -220,47 +532,27 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
-        }
-      else 
-        {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-        }
+      cache_read (sector_idx, buffer + bytes_read, sector_ofs, chunk_size);
       
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
 
   return bytes_read;
 }
 
-/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET,
+   through the buffer cache but bypassing the page cache.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
-off_t
-inode_write_at (struct inode *inode, const void *buffer_, off_t size,
-                off_t offset) 
+   less than SIZE if end of file is reached or an error occurs. */
+static off_t
+inode_write_direct (struct inode *inode, const void *buffer_, off_t size,
+                    off_t offset) 
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
 
   if (inode->deny_write_cnt)
     return 0;
@@ -281,42 +573,166 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
-        }
-      else 
-        {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
-        }
+      cache_write (sector_idx, buffer + bytes_written, sector_ofs,
+                   chunk_size);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
 
   return bytes_written;
 }
 
+/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
+   Returns the number of bytes actually read, which may be less
+   than SIZE if an error occurs or end of file is reached. */
+off_t
+inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) 
+{
+#ifdef VM
+  /* Serve the read from the page cache a page at a time. */
+  uint8_t *buffer = buffer_;
+  off_t bytes_read = 0;
+
+  while (size > 0) 
+    {
+      /* Bytes left in inode, bytes left in page, lesser of the two. */
+      off_t inode_left = inode_length (inode) - offset;
+      int page_left = PGSIZE - offset % PGSIZE;
+      int min_left = inode_left < page_left ? inode_left : page_left;
+
+      /* Number of bytes to actually copy out of this page. */
+      int chunk_size = size < min_left ? size : min_left;
+      if (chunk_size <= 0)
+        break;
+
+      page_cache_read (inode, offset, buffer + bytes_read, chunk_size);
+
+      /* Advance. */
+      size -= chunk_size;
+      offset += chunk_size;
+      bytes_read += chunk_size;
+    }
+
+  return bytes_read;
+#else
+  return inode_read_direct (inode, buffer_, size, offset);
+#endif
+}
+
+/* Extends INODE to LENGTH bytes, if it is shorter, with zeros,
+   and writes the inode back.  Returns true if successful, false
+   if the disk is full. */
+static bool
+inode_grow (struct inode *inode, off_t length) 
+{
+  off_t old_length = inode->data.length;
+
+  if (length <= old_length)
+    return true;
+  if (!inode_extend (&inode->data, inode->sector, length))
+    {
+      /* Keep any index sectors allocated on the way. */
+      cache_write (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+      return false;
+    }
+  inode->data.length = length;
+  cache_write (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+
+#ifdef VM
+  /* The cached page holding the old end of file, the only one
+     that can be cached past it, may have been written past it
+     through a file mapping.  The new bytes must read as zeros, so
+     clear them to the end of that page. */
+  while (old_length < length && old_length % PGSIZE != 0) 
+    {
+      static const char zeros[BLOCK_SECTOR_SIZE];
+      int page_left = PGSIZE - old_length % PGSIZE;
+      int chunk_size = BLOCK_SECTOR_SIZE < page_left
+                       ? BLOCK_SECTOR_SIZE : page_left;
+      if (chunk_size > length - old_length)
+        chunk_size = length - old_length;
+
+      page_cache_write (inode, old_length, zeros, chunk_size);
+      old_length += chunk_size;
+    }
+#endif
+  return true;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+   Returns the number of bytes actually written, which may be
+   less than SIZE if the disk is full or an error occurs.  A
+   write past end of file extends the inode, with zeros between
+   the old end of file and OFFSET. */
+off_t
+inode_write_at (struct inode *inode, const void *buffer_, off_t size,
+                off_t offset) 
+{
+  off_t bytes_written;
+
+  if (inode->deny_write_cnt)
+    return 0;
+
+  /* If the disk is full, the write stops at end of file. */
+  if (size > 0)
+    inode_grow (inode, offset + size);
+  bytes_written = inode_write_direct (inode, buffer_, size, offset);
+
+#ifdef VM
+  /* The write went to the buffer cache; bring any copy of the
+     data in the page cache up to date. */
+  const uint8_t *buffer = buffer_;
+  off_t done = 0;
+
+  while (done < bytes_written) 
+    {
+      int page_left = PGSIZE - (offset + done) % PGSIZE;
+      int chunk_size = bytes_written - done < page_left
+                       ? bytes_written - done : page_left;
+
+      page_cache_write (inode, offset + done, buffer + done, chunk_size);
+      done += chunk_size;
+    }
+#endif
+
+  return bytes_written;
+}
+
+/* Starts reading the sectors that hold the SIZE bytes of INODE
+   at OFFSET into the buffer cache in the background, stopping
+   at end of file. */
+void
+inode_read_ahead (struct inode *inode, off_t size, off_t offset) 
+{
+  off_t pos = offset - offset % BLOCK_SECTOR_SIZE;
+
+  for (; pos < offset + size && pos < inode_length (inode);
+       pos += BLOCK_SECTOR_SIZE)
+    cache_read_ahead (byte_to_sector (inode, pos));
+}
+
+/* Reads the page of INODE's data at page-aligned OFFSET into
+   KPAGE through the buffer cache, filling the part beyond end of
+   file with zeros.  Used by the page cache. */
+void
+inode_read_page (struct inode *inode, off_t offset, void *kpage) 
+{
+  off_t bytes_read = inode_read_direct (inode, kpage, PGSIZE, offset);
+  memset ((uint8_t *) kpage + bytes_read, 0, PGSIZE - bytes_read);
+}
+
+/* Writes the page at KPAGE back to INODE's data at page-aligned
+   OFFSET through the buffer cache, up to end of file.  Used by
+   the page cache. */
+void
+inode_write_page (struct inode *inode, off_t offset, const void *kpage) 
+{
+  inode_write_direct (inode, kpage, PGSIZE, offset);
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
@@ -0,0 +1,394 @@
+/* Red-black tree.
+
+   The algorithms follow Cormen, Leiserson, Rivest, and Stein,
+   "Introduction to Algorithms", chapter 13, with null pointers
+   standing in for the black leaves.
+
+   See rbtree.h for basic information. */
+
+#include "rbtree.h"
+#include "../debug.h"
+
+static void rotate_left (struct rb_tree *, struct rb_elem *);
+static void rotate_right (struct rb_tree *, struct rb_elem *);
+static void transplant (struct rb_tree *, struct rb_elem *,
+                        struct rb_elem *);
+static void remove_fixup (struct rb_tree *, struct rb_elem *,
+                          struct rb_elem *);
+
+/* Returns true if E is a red element, false if it is black or a
+   leaf. */
+static inline bool
+is_red (const struct rb_elem *e)
+{
+  return e != NULL && e->red;
+}
+
+/* Returns the leftmost element of the subtree rooted at E. */
+static struct rb_elem *
+subtree_min (struct rb_elem *e)
+{
+  while (e->left != NULL)
+    e = e->left;
+  return e;
+}
+
+/* Returns the rightmost element of the subtree rooted at E. */
+static struct rb_elem *
+subtree_max (struct rb_elem *e)
+{
+  while (e->right != NULL)
+    e = e->right;
+  return e;
+}
+
+/* Initializes T as an empty tree ordered by LESS, given
+   auxiliary data AUX. */
+void
+rb_init (struct rb_tree *t, rb_less_func *less, void *aux)
+{
+  t->root = NULL;
+  t->elem_cnt = 0;
+  t->less = less;
+  t->aux = aux;
+}
+
+/* Inserts E into T, after any elements equal to it. */
+void
+rb_insert (struct rb_tree *t, struct rb_elem *e)
+{
+  struct rb_elem *parent = NULL;
+  struct rb_elem **link = &t->root;
+
+  ASSERT (t != NULL);
+  ASSERT (e != NULL);
+
+  while (*link != NULL)
+    {
+      parent = *link;
+      link = t->less (e, parent, t->aux) ? &parent->left : &parent->right;
+    }
+  e->parent = parent;
+  e->left = e->right = NULL;
+  e->red = true;
+  *link = e;
+  t->elem_cnt++;
+
+  /* Restore the red-black properties: a red element may not have
+     a red parent. */
+  while (is_red (e->parent))
+    {
+      struct rb_elem *p = e->parent;
+      struct rb_elem *g = p->parent;
+
+      if (p == g->left)
+        {
+          struct rb_elem *u = g->right;
+          if (is_red (u))
+            {
+              p->red = u->red = false;
+              g->red = true;
+              e = g;
+              continue;
+            }
+          if (e == p->right)
+            {
+              e = p;
+              rotate_left (t, e);
+              p = e->parent;
+            }
+          p->red = false;
+          g->red = true;
+          rotate_right (t, g);
+        }
+      else
+        {
+          struct rb_elem *u = g->left;
+          if (is_red (u))
+            {
+              p->red = u->red = false;
+              g->red = true;
+              e = g;
+              continue;
+            }
+          if (e == p->left)
+            {
+              e = p;
+              rotate_right (t, e);
+              p = e->parent;
+            }
+          p->red = false;
+          g->red = true;
+          rotate_left (t, g);
+        }
+    }
+  t->root->red = false;
+}
+
+/* Removes E, which must be in T, from T. */
+void
+rb_remove (struct rb_tree *t, struct rb_elem *e)
+{
+  struct rb_elem *x, *x_parent;
+  bool removed_red = e->red;
+
+  ASSERT (t != NULL);
+  ASSERT (t->elem_cnt > 0);
+
+  if (e->left == NULL)
+    {
+      x = e->right;
+      x_parent = e->parent;
+      transplant (t, e, e->right);
+    }
+  else if (e->right == NULL)
+    {
+      x = e->left;
+      x_parent = e->parent;
+      transplant (t, e, e->left);
+    }
+  else
+    {
+      /* Put E's successor, which has no left child, in its
+         place. */
+      struct rb_elem *y = subtree_min (e->right);
+
+      removed_red = y->red;
+      x = y->right;
+      if (y->parent == e)
+        x_parent = y;
+      else
+        {
+          x_parent = y->parent;
+          transplant (t, y, y->right);
+          y->right = e->right;
+          y->right->parent = y;
+        }
+      transplant (t, e, y);
+      y->left = e->left;
+      y->left->parent = y;
+      y->red = e->red;
+    }
+  t->elem_cnt--;
+
+  if (!removed_red)
+    remove_fixup (t, x, x_parent);
+}
+
+/* Returns the first element of T that is not less than KEY, or a
+   null pointer if there is none. */
+struct rb_elem *
+rb_lower_bound (const struct rb_tree *t, const struct rb_elem *key)
+{
+  struct rb_elem *e = t->root;
+  struct rb_elem *found = NULL;
+
+  while (e != NULL)
+    if (t->less (e, key, t->aux))
+      e = e->right;
+    else
+      {
+        found = e;
+        e = e->left;
+      }
+  return found;
+}
+
+/* Returns the last element of T that is not greater than KEY, or
+   a null pointer if there is none. */
+struct rb_elem *
+rb_floor (const struct rb_tree *t, const struct rb_elem *key)
+{
+  struct rb_elem *e = t->root;
+  struct rb_elem *found = NULL;
+
+  while (e != NULL)
+    if (t->less (key, e, t->aux))
+      e = e->left;
+    else
+      {
+        found = e;
+        e = e->right;
+      }
+  return found;
+}
+
+/* Returns the least element of T, or a null pointer if T is
+   empty. */
+struct rb_elem *
+rb_min (const struct rb_tree *t)
+{
+  return t->root != NULL ? subtree_min (t->root) : NULL;
+}
+
+/* Returns the greatest element of T, or a null pointer if T is
+   empty. */
+struct rb_elem *
+rb_max (const struct rb_tree *t)
+{
+  return t->root != NULL ? subtree_max (t->root) : NULL;
+}
+
+/* Returns the element that follows E in its tree, or a null
+   pointer if E is the greatest. */
+struct rb_elem *
+rb_next (struct rb_elem *e)
+{
+  ASSERT (e != NULL);
+
+  if (e->right != NULL)
+    return subtree_min (e->right);
+  while (e->parent != NULL && e == e->parent->right)
+    e = e->parent;
+  return e->parent;
+}
+
+/* Returns the element that precedes E in its tree, or a null
+   pointer if E is the least. */
+struct rb_elem *
+rb_prev (struct rb_elem *e)
+{
+  ASSERT (e != NULL);
+
+  if (e->left != NULL)
+    return subtree_max (e->left);
+  while (e->parent != NULL && e == e->parent->left)
+    e = e->parent;
+  return e->parent;
+}
+
+/* Returns the number of elements in T. */
+size_t
+rb_size (const struct rb_tree *t)
+{
+  return t->elem_cnt;
+}
+
+/* Returns true if T contains no elements, false otherwise. */
+bool
+rb_empty (const struct rb_tree *t)
+{
+  return t->elem_cnt == 0;
+}
+
+/* Makes X's right child take X's place in T, with X as its left
+   child. */
+static void
+rotate_left (struct rb_tree *t, struct rb_elem *x)
+{
+  struct rb_elem *y = x->right;
+
+  x->right = y->left;
+  if (y->left != NULL)
+    y->left->parent = x;
+  transplant (t, x, y);
+  y->left = x;
+  x->parent = y;
+}
+
+/* Makes X's left child take X's place in T, with X as its right
+   child. */
+static void
+rotate_right (struct rb_tree *t, struct rb_elem *x)
+{
+  struct rb_elem *y = x->left;
+
+  x->left = y->right;
+  if (y->right != NULL)
+    y->right->parent = x;
+  transplant (t, x, y);
+  y->right = x;
+  x->parent = y;
+}
+
+/* Puts the subtree rooted at V, which may be empty, in the place
+   of U's subtree in T. */
+static void
+transplant (struct rb_tree *t, struct rb_elem *u, struct rb_elem *v)
+{
+  if (u->parent == NULL)
+    t->root = v;
+  else if (u == u->parent->left)
+    u->parent->left = v;
+  else
+    u->parent->right = v;
+  if (v != NULL)
+    v->parent = u->parent;
+}
+
+/* Restores the red-black properties of T after a black element
+   was removed from above X, whose parent is X_PARENT.  X, which
+   may be a leaf, then counts one black short. */
+static void
+remove_fixup (struct rb_tree *t, struct rb_elem *x, struct rb_elem *x_parent)
+{
+  while (x != t->root && !is_red (x))
+    {
+      if (x == x_parent->left)
+        {
+          struct rb_elem *w = x_parent->right;
+          if (is_red (w))
+            {
+              w->red = false;
+              x_parent->red = true;
+              rotate_left (t, x_parent);
+              w = x_parent->right;
+            }
+          if (!is_red (w->left) && !is_red (w->right))
+            {
+              w->red = true;
+              x = x_parent;
+              x_parent = x->parent;
+            }
+          else
+            {
+              if (!is_red (w->right))
+                {
+                  w->left->red = false;
+                  w->red = true;
+                  rotate_right (t, w);
+                  w = x_parent->right;
+                }
+              w->red = x_parent->red;
+              x_parent->red = false;
+              w->right->red = false;
+              rotate_left (t, x_parent);
+              x = t->root;
+            }
+        }
+      else
+        {
+          struct rb_elem *w = x_parent->left;
+          if (is_red (w))
+            {
+              w->red = false;
+              x_parent->red = true;
+              rotate_right (t, x_parent);
+              w = x_parent->left;
+            }
+          if (!is_red (w->left) && !is_red (w->right))
+            {
+              w->red = true;
+              x = x_parent;
+              x_parent = x->parent;
+            }
+          else
+            {
+              if (!is_red (w->left))
+                {
+                  w->right->red = false;
+                  w->red = true;
+                  rotate_left (t, w);
+                  w = x_parent->left;
+                }
+              w->red = x_parent->red;
+              x_parent->red = false;
+              w->left->red = false;
+              rotate_right (t, x_parent);
+              x = t->root;
+            }
+        }
+    }
+  if (x != NULL)
+    x->red = false;
+}
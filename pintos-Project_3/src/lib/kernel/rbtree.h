@@ -0,0 +1,81 @@
+#ifndef __LIB_KERNEL_RBTREE_H
+#define __LIB_KERNEL_RBTREE_H
+
+/* Red-black tree.
+
+   A balanced binary search tree, kept in order by a comparison
+   function supplied by the user, so that insertion, removal, and
+   searches for the first element not less than a key or the last
+   element not greater than one take O(lg n) time.
+
+   Like the list and hash table implementations, the tree does
+   not use dynamic allocation.  Each structure that can be in a
+   tree embeds a struct rb_elem member, and the rb_entry macro
+   converts a struct rb_elem back to the structure that contains
+   it.  A structure may be in several trees at once, ordered
+   differently, through several struct rb_elem members.  Refer to
+   lib/kernel/list.h for a detailed explanation of the technique.
+
+   Elements that compare equal are allowed.  A new element goes
+   after the elements equal to it. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Tree element. */
+struct rb_elem
+  {
+    struct rb_elem *parent;     /* Parent, or null for the root. */
+    struct rb_elem *left;       /* Left child, or null. */
+    struct rb_elem *right;      /* Right child, or null. */
+    bool red;                   /* Red or black. */
+  };
+
+/* Converts pointer to tree element RB_ELEM into a pointer to the
+   structure that RB_ELEM is embedded inside.  Supply the name of
+   the outer structure STRUCT and the member name MEMBER of the
+   tree element. */
+#define rb_entry(RB_ELEM, STRUCT, MEMBER)                       \
+        ((STRUCT *) ((uint8_t *) &(RB_ELEM)->parent             \
+                     - offsetof (STRUCT, MEMBER.parent)))
+
+/* Compares the value of two tree elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool rb_less_func (const struct rb_elem *a,
+                           const struct rb_elem *b,
+                           void *aux);
+
+/* Red-black tree. */
+struct rb_tree
+  {
+    struct rb_elem *root;       /* Root, or null if empty. */
+    size_t elem_cnt;            /* Number of elements in tree. */
+    rb_less_func *less;         /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `less'. */
+  };
+
+/* Basic life cycle. */
+void rb_init (struct rb_tree *, rb_less_func *, void *aux);
+
+/* Insertion and removal. */
+void rb_insert (struct rb_tree *, struct rb_elem *);
+void rb_remove (struct rb_tree *, struct rb_elem *);
+
+/* Search. */
+struct rb_elem *rb_lower_bound (const struct rb_tree *,
+                                const struct rb_elem *key);
+struct rb_elem *rb_floor (const struct rb_tree *, const struct rb_elem *key);
+
+/* Traversal, in order. */
+struct rb_elem *rb_min (const struct rb_tree *);
+struct rb_elem *rb_max (const struct rb_tree *);
+struct rb_elem *rb_next (struct rb_elem *);
+struct rb_elem *rb_prev (struct rb_elem *);
+
+/* Information. */
+size_t rb_size (const struct rb_tree *);
+bool rb_empty (const struct rb_tree *);
+
+#endif /* lib/kernel/rbtree.h */
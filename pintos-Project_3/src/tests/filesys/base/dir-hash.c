@@ -0,0 +1,89 @@
+/* Creates many files in the root directory, removes every other
+   one, and creates more in their place, so that the directory's
+   hash table fills with removed entries, reuses them, and is
+   rebuilt and grown several times.  Then checks that each file
+   that should be there opens with its own contents and that each
+   removed file is gone. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 96
+
+/* Creates the file NAME holding its own name. */
+static void
+make_file (const char *name) 
+{
+  int fd;
+
+  if (!create (name, 0))
+    fail ("create \"%s\"", name);
+  if ((fd = open (name)) < 2)
+    fail ("open \"%s\"", name);
+  if (write (fd, name, strlen (name)) != (int) strlen (name))
+    fail ("write \"%s\"", name);
+  close (fd);
+}
+
+/* Checks that the file NAME exists and holds its own name. */
+static void
+check_file_name (const char *name) 
+{
+  char buf[16];
+  int fd, size;
+
+  if ((fd = open (name)) < 2)
+    fail ("open \"%s\"", name);
+  size = read (fd, buf, sizeof buf);
+  if (size != (int) strlen (name) || memcmp (buf, name, size))
+    fail ("\"%s\" does not hold its own name", name);
+  close (fd);
+}
+
+void
+test_main (void) 
+{
+  char name[16];
+  int fd;
+  int i;
+
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "file%d", i);
+      make_file (name);
+    }
+  msg ("create %d files", FILE_CNT);
+
+  for (i = 1; i < FILE_CNT; i += 2)
+    {
+      snprintf (name, sizeof name, "file%d", i);
+      if (!remove (name))
+        fail ("remove \"%s\"", name);
+    }
+  msg ("remove every other file");
+
+  CHECK (!create ("file0", 0), "create \"file0\" again (must fail)");
+
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "refill%d", i);
+      make_file (name);
+    }
+  msg ("create %d more files", FILE_CNT);
+
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "file%d", i);
+      if (i % 2 == 0)
+        check_file_name (name);
+      else if ((fd = open (name)) != -1)
+        fail ("removed file \"%s\" opened as %d", name, fd);
+
+      snprintf (name, sizeof name, "refill%d", i);
+      check_file_name (name);
+    }
+  msg ("check all files");
+}
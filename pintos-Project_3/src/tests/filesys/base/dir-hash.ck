@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-hash) begin
+(dir-hash) create 96 files
+(dir-hash) remove every other file
+(dir-hash) create "file0" again (must fail)
+(dir-hash) create 96 more files
+(dir-hash) check all files
+(dir-hash) end
+EOF
+pass;
@@ -0,0 +1,27 @@
+/* Child process of page-cow.
+   Reads a page of initialized data, which maps it shared with
+   other processes running this program, then writes it, which
+   must give this process a copy of its own. */
+
+#include <string.h>
+#include "tests/lib.h"
+
+#define INITIAL "initial contents"
+
+/* Initialized data, so that its pages come from the executable. */
+static char data[2 * 4096] = INITIAL;
+
+int
+main (void)
+{
+  test_name = "child-cow";
+
+  if (strcmp (data, INITIAL))
+    fail ("data holds \"%s\" instead of \"%s\"", data, INITIAL);
+
+  strlcpy (data, "modified", sizeof data);
+  if (strcmp (data, "modified"))
+    fail ("write to data did not take");
+
+  return 0x42;
+}
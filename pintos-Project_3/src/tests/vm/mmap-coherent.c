@@ -0,0 +1,46 @@
+/* Maps a file and checks that data written with the write system
+   call shows up in the mapping, and that data written through the
+   mapping is returned by the read system call, both while the file
+   stays mapped. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((char *) 0x10000000)
+
+void
+test_main (void)
+{
+  int size = strlen (sample);
+  int handle;
+  mapid_t map;
+  char buf[1024];
+
+  CHECK (create ("coherent", 2 * 4096), "create \"coherent\"");
+  CHECK ((handle = open ("coherent")) > 1, "open \"coherent\"");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"coherent\"");
+
+  /* Bring the first page in, then change it with write(). */
+  if (ACTUAL[100] != 0)
+    fail ("mapping of new file does not read as zeros");
+  seek (handle, 100);
+  CHECK (write (handle, sample, size) == size,
+         "write \"coherent\" at offset 100");
+  if (memcmp (ACTUAL + 100, sample, size))
+    fail ("mapping does not see data written with write()");
+
+  /* Change the second page through the mapping, then read(). */
+  msg ("write through mapping");
+  memcpy (ACTUAL + 4096 + 10, sample, size);
+  seek (handle, 4096 + 10);
+  CHECK (read (handle, buf, size) == size,
+         "read \"coherent\" at offset 4106");
+  if (memcmp (buf, sample, size))
+    fail ("read() does not see data written through mapping");
+
+  munmap (map);
+  close (handle);
+}
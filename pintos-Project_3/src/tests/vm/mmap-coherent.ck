@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-coherent) begin
+(mmap-coherent) create "coherent"
+(mmap-coherent) open "coherent"
+(mmap-coherent) mmap "coherent"
+(mmap-coherent) write "coherent" at offset 100
+(mmap-coherent) write through mapping
+(mmap-coherent) read "coherent" at offset 4106
+(mmap-coherent) end
+EOF
+pass;
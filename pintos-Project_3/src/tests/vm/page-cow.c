@@ -0,0 +1,28 @@
+/* Runs child-cow twice in a row.  Each child reads a page of its
+   initialized data and then writes it, so if the write reached
+   the frame shared through the executable's cached pages, the
+   second child would not find the initial data.
+
+   The executable is kept open across both runs, so that its
+   cached pages are not dropped when the first child exits. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  int handle;
+  int i;
+
+  CHECK ((handle = open ("child-cow")) > 1, "open \"child-cow\"");
+  for (i = 0; i < 2; i++)
+    {
+      pid_t child;
+
+      CHECK ((child = exec ("child-cow")) != -1, "exec \"child-cow\"");
+      CHECK (wait (child) == 0x42, "wait for child %d", i);
+    }
+  close (handle);
+}
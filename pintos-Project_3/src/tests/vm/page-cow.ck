@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-cow) begin
+(page-cow) open "child-cow"
+(page-cow) exec "child-cow"
+(page-cow) wait for child 0
+(page-cow) exec "child-cow"
+(page-cow) wait for child 1
+(page-cow) end
+EOF
+pass;
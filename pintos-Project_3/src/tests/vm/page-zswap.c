@@ -0,0 +1,56 @@
+/* Writes 3 MB of memory in which every page compresses well,
+   which is more than fits in physical memory, and verifies it
+   twice.  The pages must round-trip through the compressed swap
+   cache. */
+
+#include <string.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 768
+
+static unsigned char buf[PAGE_CNT][PAGE_SIZE];
+
+/* Checks that every page of BUF holds what was written to it. */
+static void
+verify (void)
+{
+  size_t i, j;
+
+  for (i = 0; i < PAGE_CNT; i++)
+    {
+      unsigned stamp;
+
+      memcpy (&stamp, buf[i], sizeof stamp);
+      if (stamp != i)
+        fail ("page %zu is stamped %u", i, stamp);
+      for (j = sizeof stamp; j < PAGE_SIZE; j++)
+        if (buf[i][j] != (unsigned char) (i + j / 64))
+          fail ("byte %zu of page %zu is %02hhx, should be %02hhx",
+                j, i, buf[i][j], (unsigned char) (i + j / 64));
+    }
+}
+
+void
+test_main (void)
+{
+  size_t i, j;
+
+  /* Fill each page with runs of a byte that depends on the page,
+     after a stamp with the page's number. */
+  msg ("initialize");
+  for (i = 0; i < PAGE_CNT; i++)
+    {
+      unsigned stamp = i;
+
+      for (j = 0; j < PAGE_SIZE; j++)
+        buf[i][j] = i + j / 64;
+      memcpy (buf[i], &stamp, sizeof stamp);
+    }
+
+  msg ("read pass one");
+  verify ();
+  msg ("read pass two");
+  verify ();
+}
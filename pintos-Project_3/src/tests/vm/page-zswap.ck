@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-zswap) begin
+(page-zswap) initialize
+(page-zswap) read pass one
+(page-zswap) read pass two
+(page-zswap) end
+EOF
+our ($test);
+my (@output) = read_text_file ("$test.output");
+my ($loads) = grep (defined, map (/^Zswap: .* (\d+) loads$/, @output));
+fail "No pages were loaded from the compressed swap cache.\n"
+  if !defined $loads || $loads == 0;
+pass;
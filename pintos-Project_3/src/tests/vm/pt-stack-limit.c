@@ -0,0 +1,40 @@
+/* Grows the stack by 32 kB, within the 64 kB limit the test runs
+   with, then tries to grow it by 128 kB, past the limit.  The
+   process must be terminated with -1 exit code. */
+
+#include <string.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Fills a stack object of SIZE bytes and checks one of its bytes,
+   so that the object is not optimized away. */
+#define GROW(SIZE)                                              \
+  do                                                            \
+    {                                                           \
+      volatile char stack_obj[SIZE];                            \
+      memset ((char *) stack_obj, 0x5a, sizeof stack_obj);      \
+      if (stack_obj[0] != 0x5a)                                 \
+        fail ("stack object holds bad data");                   \
+    }                                                           \
+  while (0)
+
+static void __attribute__ ((noinline))
+grow_within (void)
+{
+  GROW (32 * 1024);
+}
+
+static void __attribute__ ((noinline))
+grow_past (void)
+{
+  GROW (128 * 1024);
+}
+
+void
+test_main (void)
+{
+  grow_within ();
+  msg ("grew stack by 32 kB");
+  grow_past ();
+  fail ("grew stack by 128 kB past its 64 kB limit");
+}
@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_USER_FAULTS => 1, [<<'EOF']);
+(pt-stack-limit) begin
+(pt-stack-limit) grew stack by 32 kB
+pt-stack-limit: exit(-1)
+EOF
+pass;
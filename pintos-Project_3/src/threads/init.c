@@ -32,6 +32,7 @@
 #include "tests/threads/tests.h"
 #endif
 #include "vm/swap.h"
+#include "vm/zswap.h"
 #include "vm/file.h"
 #ifdef FILESYS
 #include "devices/block.h"
@@ -56,9 +57,30 @@ static const char *swap_bdev_name;
 #endif
 #endif /* FILESYS */
 
+/* -nopse: Map kernel memory with 4 kB pages only? */
+static bool no_large_pages;
+
 /* -ul: Maximum number of pages to put into palloc's user pool. */
 static size_t user_page_limit = SIZE_MAX;
 
+#ifdef VM
+/* -wl, -wh: Free user frames below which the page-out daemon
+   wakes, and up to which it then evicts.  SIZE_MAX picks the
+   default. */
+static size_t pageout_low = SIZE_MAX;
+static size_t pageout_high = SIZE_MAX;
+
+/* -rss: Frames a process may hold before its pages are preferred
+   for eviction.  SIZE_MAX gives each process an equal share. */
+static size_t rss_limit = SIZE_MAX;
+
+/* -sl: Maximum size of a user stack, in pages. */
+static size_t stack_limit = 2048;
+
+/* -zswap: Kernel pages for compressed swap, or 0 for none. */
+static size_t zswap_pages = 32;
+#endif
+
 static void bss_init (void);
 static void paging_init (void);
 
@@ -121,6 +143,12 @@ main (void)
   serial_init_queue ();
   timer_calibrate ();
 
+#ifdef VM
+  /* File reads go through the page cache, which lives in the frame
+     table, from the moment the file system is mounted. */
+  lru_list_init();
+#endif
+
 #ifdef FILESYS
   /* Initialize file system. */
   ide_init ();
@@ -130,7 +158,10 @@ main (void)
 
 #ifdef VM
   swap_init();
-  lru_list_init();
+  zswap_init (zswap_pages);
+  pageout_init (pageout_low, pageout_high);
+  rss_limit_init (rss_limit);
+  stack_limit_init (stack_limit);
 #endif
 
   printf ("Boot complete.\n");
@@ -156,16 +187,45 @@ bss_init (void)
   memset (&_start_bss, 0, &_end_bss - &_start_bss);
 }
 
+/* Returns true if the CPU supports 4 MB pages, according to the
+   PSE bit of CPUID function 1.  See [IA32-v2a] "CPUID--CPU
+   Identification". */
+static bool
+cpu_has_pse (void)
+{
+  uint32_t eax = 1, ebx, ecx, edx;
+
+  asm volatile ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  return (edx & (1 << 3)) != 0;
+}
+
 /* Populates the base page directory and page table with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points init_page_dir to the page
-   directory it creates. */
+   directory it creates.
+
+   Each 4 MB of physical memory that lies wholly in RAM and
+   holds no kernel code is mapped by a single 4 MB PDE when the
+   CPU supports it, which takes fewer TLB entries and page
+   tables.  The kernel code stays in 4 kB pages so that it can be
+   mapped read-only. */
 static void
 paging_init (void)
 {
   uint32_t *pd, *pt;
   size_t page;
   extern char _start, _end_kernel_text;
+  bool large_pages = !no_large_pages && cpu_has_pse ();
+
+  /* The CPU honors PTE_PS only with CR4.PSE set, so set it
+     before any PDE uses it.  See [IA32-v3a] 2.5 "Control
+     Registers". */
+  if (large_pages)
+    {
+      uint32_t cr4;
+      asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4 | (1 << 4)));
+    }
 
   pd = init_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
   pt = NULL;
@@ -177,6 +237,15 @@ paging_init (void)
       size_t pte_idx = pt_no (vaddr);
       bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
+      if (large_pages && pte_idx == 0
+          && init_ram_pages - page >= PTSPAN / PGSIZE
+          && (vaddr + PTSPAN <= &_start || vaddr >= &_end_kernel_text))
+        {
+          pd[pde_idx] = pde_create_large (vaddr, true);
+          page += PTSPAN / PGSIZE - 1;
+          continue;
+        }
+
       if (pd[pde_idx] == 0)
         {
           pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
@@ -262,9 +331,25 @@ parse_options (char **argv)
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-nopse"))
+        no_large_pages = true;
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-wl"))
+        pageout_low = atoi (value);
+      else if (!strcmp (name, "-wh"))
+        pageout_high = atoi (value);
+      else if (!strcmp (name, "-rss"))
+        rss_limit = atoi (value);
+      else if (!strcmp (name, "-sl"))
+        stack_limit = atoi (value);
+      else if (!strcmp (name, "-zswap"))
+        zswap_pages = atoi (value);
+      else if (!strcmp (name, "-vmtrace"))
+        vm_trace = true;
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -385,8 +470,18 @@ usage (void)
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -nopse             Map kernel memory with 4 kB pages only.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+          "  -wl=COUNT          Start paging out below COUNT free frames.\n"
+          "  -wh=COUNT          Page out until COUNT frames are free.\n"
+          "  -rss=COUNT         Prefer evicting from processes over COUNT frames.\n"
+          "  -sl=COUNT          Limit user stacks to COUNT pages (default 2048).\n"
+          "  -zswap=COUNT       Keep swapped pages compressed in COUNT kernel pages\n"
+          "                     (default 32), spilling to the swap device.\n"
+          "  -vmtrace           Log each page fault and eviction.\n"
 #endif
           );
   shutdown_power_off ();
@@ -148,6 +148,26 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Returns the number of pages in the user pool.  Frame-level
+   bookkeeping (see vm/file.c) sizes its tables from this. */
+size_t
+palloc_user_page_cnt (void) 
+{
+  return bitmap_size (user_pool.used_map);
+}
+
+/* Returns the index of PAGE, which must have been obtained from
+   the user pool, within that pool: 0 for the first user page,
+   up to palloc_user_page_cnt() - 1 for the last. */
+size_t
+palloc_user_page_idx (const void *page) 
+{
+  ASSERT (pg_ofs (page) == 0);
+  ASSERT (page_from_pool (&user_pool, (void *) page));
+
+  return pg_no (page) - pg_no (user_pool.base);
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
@@ -478,6 +478,9 @@ init_thread (struct thread *t, const char *name, int priority)
   sema_init(&t->mem_lock, 0); 
   sema_init(&t->load_lock, 0); 
   list_init(&(t->child));
+  list_init(&t->mmap_list);
+  list_init(&t->vma_list);
+  t->next_mapid = 1;
   list_push_back(&(running_thread()->child), &(t->child_elem));
 #endif  
 }
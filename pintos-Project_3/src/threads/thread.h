@@ -106,11 +106,17 @@ struct thread
     struct list_elem child_elem;
     int exit_status;
     struct file* fd[200];
+    struct file* exec_file;             /* Running executable, kept open. */
+    void *esp;                          /* User esp at system call entry. */
+    struct list mmap_list;              /* File mappings (struct mmap_file). */
+    struct list vma_list;               /* Regions (struct vm_area), by address. */
+    int next_mapid;                     /* Identifier for the next mapping. */
 #endif
 
     /* Owned by thread.c. */
     unsigned magic;                     /* Detects stack overflow. */
     struct hash vm;  /*Hash table to manage virtual address space of thread*/
+    size_t rss;      /* Frames held by the thread, under lru_list_lock. */
   };
 
 /* If false (default), use round-robin scheduler.
@@ -5,6 +5,8 @@
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "userprog/process.h"
+#include "userprog/syscall.h"
 #include "vm/page.h"
 
 /* Number of page faults processed. */
@@ -150,16 +152,27 @@ page_fault (struct intr_frame *f)
    write = (f->error_code & PF_W) != 0;
    user = (f->error_code & PF_U) != 0;
 
-   if(!user || is_kernel_vaddr(fault_addr) || not_present) {
+   /* A kernel thread has no process, so no vm table or regions to
+      look the address up in: any fault it takes is a kernel bug. */
+   if (!user && thread_current ()->pagedir == NULL)
+      kill (f);
+
+   /* Accesses to kernel addresses are never satisfiable.  A user
+      address, whether touched by the process or by the kernel on
+      its behalf during a system call, is brought in from its
+      vm_entry; a write to a present page is satisfiable only if the
+      page is mapped to the shared zero page. */
+   if (is_kernel_vaddr(fault_addr) || (!not_present && !write))
       exit(-1);
-   }
-
-   if (!not_present)
-      exit (-1);
 
+   /* An access just below the user stack pointer grows the stack.
+      In the kernel, f->esp is the kernel's stack pointer, so take
+      the one saved at system call entry. */
    struct vm_entry *vme = find_vme(fault_addr);
+   if (vme == NULL)
+      vme = grow_stack(fault_addr, user ? f->esp : thread_current()->esp);
 
-   if (!handle_mm_fault(vme)) {
+   if (vme == NULL || !handle_mm_fault(vme, write)) {
       exit(-1);
    }
 
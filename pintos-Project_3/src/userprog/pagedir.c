@@ -7,7 +7,7 @@
 #include "threads/palloc.h"
 
 static uint32_t *active_pd (void);
-static void invalidate_pagedir (uint32_t *);
+static void invalidate_page (uint32_t *, const void *);
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
@@ -80,7 +80,9 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
         return NULL;
     }
 
-  /* Return the page table entry. */
+  /* Return the page table entry.  Only kernel memory is mapped
+     by 4 MB pages, which have no page table. */
+  ASSERT (!(*pde & PTE_PS));
   pt = pde_get_pt (*pde);
   return &pt[pt_no (vaddr)];
 }
@@ -152,7 +154,7 @@ pagedir_clear_page (uint32_t *pd, void *upage)
   if (pte != NULL && (*pte & PTE_P) != 0)
     {
       *pte &= ~PTE_P;
-      invalidate_pagedir (pd);
+      invalidate_page (pd, upage);
     }
 }
 
@@ -180,7 +182,7 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
       else 
         {
           *pte &= ~(uint32_t) PTE_D;
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
@@ -209,7 +211,7 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
       else 
         {
           *pte &= ~(uint32_t) PTE_A; 
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
@@ -243,21 +245,66 @@ active_pd (void)
   return ptov (pd);
 }
 
-/* Seom page table changes can cause the CPU's translation
+/* Some page table changes can cause the CPU's translation
    lookaside buffer (TLB) to become out-of-sync with the page
-   table.  When this happens, we have to "invalidate" the TLB by
-   re-activating it.
+   table.  When this happens, we have to "invalidate" the stale
+   TLB entry.
 
-   This function invalidates the TLB if PD is the active page
-   directory.  (If PD is not active then its entries are not in
-   the TLB, so there is no need to invalidate anything.) */
+   This function invalidates the TLB entry for VPAGE if PD is the
+   active page directory.  (If PD is not active then its entries
+   are not in the TLB, so there is no need to invalidate
+   anything.)  INVLPG drops just that entry, so the rest of the
+   TLB survives, unlike with a reload of CR3.  See [IA32-v2a]
+   "INVLPG--Invalidate TLB Entry". */
 static void
-invalidate_pagedir (uint32_t *pd) 
+invalidate_page (uint32_t *pd, const void *vpage) 
 {
   if (active_pd () == pd) 
+    asm volatile ("invlpg (%0)" : : "r" (vpage) : "memory");
+}
+
+/* Starts BATCH out empty. */
+void
+pagedir_batch_init (struct tlb_batch *batch) 
+{
+  batch->cnt = 0;
+}
+
+/* Clears the accessed bit in the PTE for virtual page VPAGE in
+   PD, leaving the TLB entry for it to be invalidated by
+   pagedir_batch_flush().  Until then, accesses through the stale
+   entry do not set the accessed bit again, so BATCH must be
+   flushed before the process can run again, as a context switch
+   does anyway. */
+void
+pagedir_clear_accessed (uint32_t *pd, const void *vpage,
+                        struct tlb_batch *batch) 
+{
+  uint32_t *pte = lookup_page (pd, vpage, false);
+  if (pte != NULL && (*pte & PTE_A) != 0) 
     {
-      /* Re-activating PD clears the TLB.  See [IA32-v3a] 3.12
-         "Translation Lookaside Buffers (TLBs)". */
-      pagedir_activate (pd);
-    } 
+      *pte &= ~(uint32_t) PTE_A;
+      if (active_pd () == pd && batch->cnt <= TLB_BATCH_MAX)
+        {
+          if (batch->cnt < TLB_BATCH_MAX)
+            batch->pages[batch->cnt] = vpage;
+          batch->cnt++;
+        }
+    }
+}
+
+/* Invalidates the TLB entries recorded in BATCH, one at a time
+   if there are few of them, or by reloading CR3 once if there
+   were more than TLB_BATCH_MAX.  Leaves BATCH empty. */
+void
+pagedir_batch_flush (struct tlb_batch *batch) 
+{
+  size_t i;
+
+  if (batch->cnt > TLB_BATCH_MAX)
+    pagedir_activate (active_pd ());
+  else
+    for (i = 0; i < batch->cnt; i++)
+      asm volatile ("invlpg (%0)" : : "r" (batch->pages[i]) : "memory");
+  batch->cnt = 0;
 }
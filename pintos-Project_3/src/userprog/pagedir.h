@@ -2,8 +2,21 @@
 #define USERPROG_PAGEDIR_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+/* Most TLB entries a batch invalidates one at a time.  Past
+   this, a batch flushes the whole TLB. */
+#define TLB_BATCH_MAX 32
+
+/* TLB invalidations deferred across many PTE updates, such as
+   the accessed bits cleared by a sweep of the clock. */
+struct tlb_batch
+  {
+    size_t cnt;                         /* Pages recorded so far. */
+    const void *pages[TLB_BATCH_MAX];   /* Pages to invalidate. */
+  };
+
 uint32_t *pagedir_create (void);
 void pagedir_destroy (uint32_t *pd);
 bool pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool rw);
@@ -15,4 +28,9 @@ bool pagedir_is_accessed (uint32_t *pd, const void *upage);
 void pagedir_set_accessed (uint32_t *pd, const void *upage, bool accessed);
 void pagedir_activate (uint32_t *pd);
 
+void pagedir_batch_init (struct tlb_batch *);
+void pagedir_clear_accessed (uint32_t *pd, const void *upage,
+                             struct tlb_batch *);
+void pagedir_batch_flush (struct tlb_batch *);
+
 #endif /* userprog/pagedir.h */
@@ -14,12 +14,14 @@
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "vm/page.h"
 #include "vm/file.h"
 #include "vm/swap.h"
+#include "userprog/syscall.h"
 
 static thread_func start_process NO_RETURN;
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
@@ -242,9 +244,18 @@ process_exit (void)
   struct thread *cur = thread_current ();
   uint32_t *pd;
 
+  /* Write back and remove the file mappings. */
+  while (!list_empty (&cur->mmap_list))
+    munmap (list_entry (list_front (&cur->mmap_list),
+                        struct mmap_file, elem)->mapid);
+
   /* Destroy vm_entry hash */
   vm_destroy(&cur->vm);
 
+  /* Close the executable now that no vm_entry refers to it. */
+  file_close(cur->exec_file);
+  cur->exec_file = NULL;
+
   /* Destroy the current process's page directory and switch back
      to the kernel-only page directory. */
   pd = cur->pagedir;
@@ -377,6 +388,7 @@ load (const char *file_name, void (**eip) (void), void **esp)
       printf ("load: %s: open failed\n", file_name);
       goto done; 
     }
+  file_deny_write (file);
 
   /* Read and verify executable header. */
   if (file_read (file, &ehdr, sizeof ehdr) != sizeof ehdr
@@ -460,8 +472,13 @@ load (const char *file_name, void (**eip) (void), void **esp)
   success = true;
 
  done:
-  /* We arrive here whether the load is successful or not. */
-  file_close (file);
+  /* We arrive here whether the load is successful or not.
+     On success the executable stays open: its VM_BIN pages are
+     read from it on demand, and process_exit() closes it. */
+  if (success)
+    t->exec_file = file;
+  else
+    file_close (file);
   return success;
 }
 
@@ -526,8 +543,13 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
    The pages initialized by this function must be writable by the
    user process if WRITABLE is true, read-only otherwise.
 
+   Pages are not read here.  The segment is registered as one
+   VM_BIN vm_area, whose pages get their vm_entries and are loaded
+   by handle_mm_fault() when first touched, so FILE must stay open
+   for the life of the process.
+
    Return true if successful, false if a memory allocation error
-   or disk read error occurs. */
+   occurs. */
 static bool
 load_segment (struct file *file, off_t ofs, uint8_t *upage,
               uint32_t read_bytes, uint32_t zero_bytes, bool writable) 
@@ -536,55 +558,22 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
-  file_seek (file, ofs);
-  while (read_bytes > 0 || zero_bytes > 0) 
-    {
-      /* Calculate how to fill this page.
-         We will read PAGE_READ_BYTES bytes from FILE
-         and zero the final PAGE_ZERO_BYTES bytes. */
-      size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-      size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-      /* Get a page of memory. */
-      uint8_t *kpage = palloc_get_page (PAL_USER);
-      if (kpage == NULL)
-        return false;
-
-      /* Load this page. */
-      if (file_read (file, kpage, page_read_bytes) != (int) page_read_bytes)
-        {
-          palloc_free_page (kpage);
-          return false; 
-        }
-      memset (kpage + page_read_bytes, 0, page_zero_bytes);
+  struct vm_area *vma = malloc (sizeof (struct vm_area));
+  if (vma == NULL)
+    return false;
 
-      /* Add the page to the process's address space. */
-      if (!install_page (upage, kpage, writable)) 
-        {
-          palloc_free_page (kpage);
-          return false; 
-        }
+  vma->type = VM_BIN;
+  vma->start = upage;
+  vma->end = upage + read_bytes + zero_bytes;
+  vma->writable = writable;
+  vma->file = file;
+  vma->offset = ofs;
+  vma->read_bytes = read_bytes;
 
-      // //vm entry 
-      // struct vm_entry *vme = malloc(sizeof(struct vm_entry));
-      // //vm_entry 
-      // vme->type = VM_BIN;
-      // vme->vaddr = upage;
-      // vme->writable = writable;
-      // vme->is_loaded = false;
-      // vme->file = file;
-      // vme->offset = ofs;
-      // vme->read_bytes =page_read_bytes;
-      // vme->zero_bytes =page_zero_bytes;
-
-      // //insert_vme()
-      // insert_vme(&thread_current()->vm, vme);
-
-      /* Advance. */
-      read_bytes -= page_read_bytes;
-      zero_bytes -= page_zero_bytes;
-      ofs   += page_read_bytes;
-      upage += PGSIZE;
+  if (!insert_vma (&thread_current ()->vma_list, vma))
+    {
+      free (vma);
+      return false;
     }
   return true;
 }
@@ -596,34 +585,43 @@ setup_stack(void **esp) {
   // Calculate the user virtual address for the top of the stack
   void *upage = ((uint8_t *)PHYS_BASE) - PGSIZE;
 
-  // Allocate a page for the stack and zero its contents
-  struct page *kpage = alloc_page(PAL_USER | PAL_ZERO);
-
-  // Check if page allocation and installation in the page table are successful
-  if (install_page(upage, kpage->kaddr, true)) {
-    // Set the stack pointer (*esp) to the top of the stack
-    *esp = PHYS_BASE;
-
-    // Create a virtual memory entry for the stack
-    struct vm_entry *vme = malloc(sizeof(struct vm_entry));
-
-    // Initialize the virtual memory entry
-    vme->type = VM_ANON;
-    vme->vaddr = upage;
-    vme->writable = true;
-    vme->is_loaded = true;
+  // Create and register the virtual memory entry for the stack first, so
+  // that it is fully initialized before the clock can reach it
+  struct vm_entry *vme = malloc(sizeof(struct vm_entry));
+  if (vme == NULL)
+    return false;
+  vme->type = VM_ANON;
+  vme->vaddr = upage;
+  vme->writable = true;
+  vme->is_loaded = false;
+  vme->file = NULL;
+  vme->offset = 0;
+  vme->read_bytes = 0;
+  vme->zero_bytes = PGSIZE;
+  if (!insert_vme(&(thread_current()->vm), vme)) {
+    free(vme);
+    return false;
+  }
 
-    // Associate the virtual memory entry with the allocated page
-    kpage->vme = vme;
+  // Allocate a page for the stack and zero its contents.  It has no
+  // vm_entry yet, so the clock passes over it until it is mapped.
+  struct page *kpage = alloc_page(PAL_USER | PAL_ZERO);
 
-    // Insert the virtual memory entry into the thread's VM list
-    insert_vme(&(thread_current()->vm), vme);
-  } else {
-    // If page allocation or installation fails, free the allocated page and return false
+  // Check if installation in the page table is successful
+  if (!install_page(upage, kpage->kaddr, true)) {
+    // If installation fails, free the allocated page and the entry
     free_page(kpage->kaddr);
+    delete_vme(&(thread_current()->vm), vme);
     return false;
   }
 
+  // Associate the virtual memory entry with the allocated page
+  vme->is_loaded = true;
+  kpage->vme = vme;
+
+  // Set the stack pointer (*esp) to the top of the stack
+  *esp = PHYS_BASE;
+
   // Return true to indicate successful stack setup
   return true;
 }
@@ -648,44 +646,253 @@ install_page (void *upage, void *kpage, bool writable)
           && pagedir_set_page (t->pagedir, upage, kpage, writable));
 }
 
-/* handle page fault */
-bool handle_mm_fault(struct vm_entry *vme) {
+/* Reads VME's page from swap into KPAGE.  Up to SWAP_CLUSTER - 1
+   following pages of the process that were swapped out into the
+   following slots, as try_to_free_pages() clusters them, are read
+   by the same request and mapped too, as long as free frames are
+   at hand.  Pages read ahead are mapped with their accessed bits
+   clear and keep their swap slots, as pages written back by the
+   page cleaner do, so that the clock reclaims them first and
+   without writing them again if they go unused.  The slot is freed
+   once the page is dirtied and written out again, or released.
+   KPAGE's own slot is left to the caller, to free once the page is
+   mapped. */
+static void
+swap_in_readahead (struct vm_entry *vme, struct page *kpage)
+{
+  struct page *pages[SWAP_CLUSTER];
+  void *kaddrs[SWAP_CLUSTER];
+  size_t cnt = 0;
+  size_t i;
+
+  pages[cnt] = kpage;
+  kaddrs[cnt++] = kpage->kaddr;
+  while (cnt < SWAP_CLUSTER)
+    {
+      uint8_t *upage = (uint8_t *) vme->vaddr + cnt * PGSIZE;
+      struct vm_entry *next;
+      struct page *page;
+
+      if (!is_user_vaddr (upage))
+        break;
+      next = lookup_vme (upage);
+      if (next == NULL || next->type != VM_ANON || next->is_loaded
+          || next->swap_slot != vme->swap_slot + cnt)
+        break;
+      page = alloc_page_nowait (PAL_USER);
+      if (page == NULL)
+        break;
+      next->pinned = true;
+      page->vme = next;
+      pages[cnt] = page;
+      kaddrs[cnt++] = page->kaddr;
+    }
+
+  swap_in_cluster (vme->swap_slot, kaddrs, cnt);
+
+  for (i = 1; i < cnt; i++)
+    {
+      struct vm_entry *next = pages[i]->vme;
+      if (install_page (next->vaddr, pages[i]->kaddr, next->writable))
+        next->is_loaded = true;
+      else
+        free_page (pages[i]->kaddr);
+      next->pinned = false;
+    }
+}
+
+/* Returns true if VME's page holds only zeros and has never been
+   written, so that it may be mapped to the shared zero page. */
+static bool
+vme_is_zero_fill (struct vm_entry *vme)
+{
+  if (vme->type == VM_BIN)
+    return vme->read_bytes == 0;
+  return vme->type == VM_ANON && vme->swap_slot == SWAP_NONE;
+}
+
+/* Returns true if VME's page holds executable data that may be
+   shared with other processes running the same executable. */
+static bool
+vme_is_shareable (struct vm_entry *vme)
+{
+  return vme->type == VM_BIN && vme->read_bytes > 0;
+}
+
+/* Brings in the page described by VME, WRITE telling whether the
+   faulting access was a write.  A read of a page of zeros maps the
+   shared zero page, and a read of executable data maps a frame
+   shared by every process running the executable.  Both are mapped
+   read-only, and the first write to a writable page gives it a
+   frame of its own.  Sets *MAJOR to true if the data had to be
+   read from disk.
+   Returns true if the page is now mapped, false otherwise. */
+static bool
+fault_in_page (struct vm_entry *vme, bool write, bool *major)
+{
+  uint32_t *pd = thread_current()->pagedir;
   struct page *kpage;
+  bool share = false, copy = false;
+  bool swapped = false;
+  bool success = false;
+
+  ASSERT(vme != NULL);
 
-  // Allocate a physical page
+  // Mapped files are mapped straight from the page cache
+  if (vme->type == VM_FILE)
+    return !vme->is_loaded && map_cached_page(vme, major);
+
+  if (vme->is_loaded) {
+    // Only a write to a page mapped read-only for sharing faults on a
+    // resident page
+    if (!write || !vme->writable)
+      return false;
+    if (pagedir_get_page(pd, vme->vaddr) == zero_page) {
+      pagedir_clear_page(pd, vme->vaddr);
+      vme->is_loaded = false;
+    } else
+      copy = true;
+  } else if (!write || !vme->writable) {
+    // The page will be mapped read-only, so it may be shared
+    if (vme_is_zero_fill(vme)) {
+      if (!install_page(vme->vaddr, zero_page, false))
+        return false;
+      vme->is_loaded = true;
+      return true;
+    }
+    if (vme_is_shareable(vme)) {
+      if (map_shared_page(vme))
+        return true;
+      share = true;
+    }
+  }
+
+  // Keep the clock away from the frame while it is being filled
+  vme->pinned = true;
+
+  // Allocate a physical page (alloc_page() puts it on the LRU list).  A
+  // page to be shared is left without a vm_entry until it is entered into
+  // the shared page table, so the clock passes over it meanwhile.
   kpage = alloc_page(PAL_USER);
   ASSERT(kpage != NULL);
   ASSERT(pg_ofs(kpage->kaddr) == 0);
-  ASSERT(vme != NULL);
-  kpage->vme = vme;
+  if (!share)
+    kpage->vme = vme;
 
-  switch (vme->type) {
+  if (copy && copy_shared_page(vme, kpage->kaddr)) {
+    // Copied from the shared page
+  } else if (vme_is_zero_fill(vme)) {
+    memset(kpage->kaddr, 0, PGSIZE);
+  } else switch (vme->type) {
     case VM_BIN:
-    case VM_FILE:
       // Load data from file into the allocated physical page
-      if (!load_file(kpage->kaddr, vme) ||
-          !install_page(vme->vaddr, kpage->kaddr, vme->writable)) {
-        NOT_REACHED();
-        free_page_kaddr(kpage);
-        return false;
+      *major = true;
+      if (!load_file(kpage->kaddr, vme)) {
+        free_page(kpage->kaddr);
+        goto done;
       }
-      vme->is_loaded = true;
-      add_page_to_lru_list(kpage);
-      return true;
+      break;
     case VM_ANON:
-      // Load data from swap into the allocated physical page
-      swap_in(vme->swap_slot, kpage->kaddr);
-      ASSERT(pg_ofs(kpage->kaddr) == 0);
-      if (!install_page(vme->vaddr, kpage->kaddr, vme->writable)) {
-        NOT_REACHED();
-        free_page_kaddr(kpage);
-        return false;
-      }
-      vme->is_loaded = true;
-      add_page_to_lru_list(kpage);
-      return true;
+      // Load data from swap, along with the pages swapped out next to it
+      *major = true;
+      swap_in_readahead(vme, kpage);
+      swapped = true;
+      break;
     default:
       NOT_REACHED();
   }
+
+  if (share) {
+    success = add_shared_page(kpage, vme);
+    goto done;
+  }
+
+  // On failure the page keeps its swap slot, so it can be faulted in again
+  if (!install_page(vme->vaddr, kpage->kaddr, vme->writable)) {
+    free_page(kpage->kaddr);
+    goto done;
+  }
+  if (swapped) {
+    swap_free(vme->swap_slot);
+    vme->swap_slot = SWAP_NONE;
+  }
+  vme->is_loaded = true;
+  success = true;
+
+ done:
+  vme->pinned = false;
+  return success;
+}
+
+/* Number of pages around a faulting page, in an aligned window,
+   that fault_around() tries to map. */
+#define FAULT_AROUND_PAGES 16
+
+/* Maps the pages in the FAULT_AROUND_PAGES window around VME's
+   page whose data is already in memory, that is, pages of zeros
+   and file and executable pages in the shared page table, so that
+   scans through them take fewer faults.  They are mapped as on a
+   read fault.  Nothing is read, and a page that has no vm_entry
+   yet gets one only if it is mapped. */
+static void
+fault_around (struct vm_entry *vme)
+{
+  uint8_t *start = (uint8_t *) ((uintptr_t) vme->vaddr
+                                & ~(uintptr_t) (FAULT_AROUND_PAGES * PGSIZE - 1));
+  size_t i;
+
+  for (i = 0; i < FAULT_AROUND_PAGES; i++)
+    {
+      uint8_t *upage = start + i * PGSIZE;
+      struct vm_entry desc, *next, *page;
+
+      if (!is_user_vaddr (upage))
+        break;
+      next = lookup_vme (upage);
+      if (next != NULL)
+        {
+          if (next->is_loaded)
+            continue;
+          page = next;
+        }
+      else if (describe_vme (upage, &desc))
+        page = &desc;
+      else
+        continue;
+
+      if (vme_is_zero_fill (page))
+        {
+          if (next == NULL)
+            next = find_vme (upage);
+          if (next != NULL && install_page (next->vaddr, zero_page, false))
+            next->is_loaded = true;
+        }
+      else if ((vme_is_shareable (page) || page->type == VM_FILE)
+               && shared_page_cached (page))
+        {
+          if (next == NULL)
+            next = find_vme (upage);
+          if (next != NULL)
+            map_shared_page (next);
+        }
+    }
 }
 
+/* Brings in the page described by VME on a page fault, WRITE
+   telling whether the faulting access was a write, along with
+   neighbouring pages that are already in memory.
+   Returns true if the page is now mapped, false otherwise. */
+bool
+handle_mm_fault (struct vm_entry *vme, bool write)
+{
+  bool major = false;
+
+  /* The page may be on its way out to swap, unmapped but not yet
+     marked as not loaded. */
+  wait_page_io (vme);
+  if (!fault_in_page (vme, write, &major))
+    return false;
+  vm_count_fault (vme, major);
+  fault_around (vme);
+  return true;
+}
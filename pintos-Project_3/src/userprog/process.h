@@ -8,4 +8,7 @@ int process_wait (tid_t);
 void process_exit (void);
 void process_activate (void);
 
+struct vm_entry;
+bool handle_mm_fault (struct vm_entry *, bool write);
+
 #endif /* userprog/process.h */
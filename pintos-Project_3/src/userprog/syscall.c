@@ -4,9 +4,20 @@
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "devices/shutdown.h"
 #include "filesys/off_t.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#include "vm/page.h"
+#include <round.h>
+#include <string.h>
 
 static void syscall_handler (struct intr_frame *);
+static void validate(const void *vaddr);
 
 struct lock filesys_lock;
 
@@ -20,6 +31,10 @@ syscall_init (void)
 static void
 syscall_handler (struct intr_frame *f UNUSED) 
 {
+  // Page faults taken in the kernel on the process's behalf need the user
+  // stack pointer to tell stack growth from stray accesses.
+  thread_current()->esp = f->esp;
+
   // Switch based on the system call number.
   switch (*(uint32_t *)(f->esp)) {
     case SYS_HALT:
@@ -76,6 +91,15 @@ syscall_handler (struct intr_frame *f UNUSED)
       validate(f->esp + 4); // Validate the user pointer.
       close((int)*(uint32_t *)(f->esp + 4)); // System call to close a file.
       break;
+    case SYS_MMAP:
+      validate(f->esp + 4); // Validate the user pointer.
+      validate(f->esp + 8); // Validate the user pointer.
+      f->eax = mmap((int)*(uint32_t *)(f->esp + 4), (void *)*(uint32_t *)(f->esp + 8)); // System call to map a file into memory.
+      break;
+    case SYS_MUNMAP:
+      validate(f->esp + 4); // Validate the user pointer.
+      munmap((mapid_t)*(uint32_t *)(f->esp + 4)); // System call to unmap a mapped file.
+      break;
   }
   // printf ("system call!\n");
   // thread_exit ();
@@ -265,3 +289,124 @@ int write(int fd, const void *buffer, unsigned size) {
     lock_release(&filesys_lock);
     return ret;
 }
+
+// Returns the open file for fd, or exits if fd is not an open file.
+static struct file *fd_file(int fd) {
+    if (fd < 3 || fd >= 128 || thread_current()->fd[fd] == NULL) {
+        exit(-1);
+    }
+    return thread_current()->fd[fd];
+}
+
+// Changes the next byte to be read or written in an open file.
+void seek(int fd, unsigned position) {
+    struct file *fp = fd_file(fd);
+
+    lock_acquire(&filesys_lock);
+    file_seek(fp, position);
+    lock_release(&filesys_lock);
+}
+
+// Returns the position of the next byte to be read or written in an open file.
+unsigned tell(int fd) {
+    struct file *fp = fd_file(fd);
+    unsigned ret;
+
+    lock_acquire(&filesys_lock);
+    ret = file_tell(fp);
+    lock_release(&filesys_lock);
+    return ret;
+}
+
+// Closes a file.
+void close(int fd) {
+    struct file *fp = fd_file(fd);
+
+    lock_acquire(&filesys_lock);
+    file_close(fp);
+    lock_release(&filesys_lock);
+    thread_current()->fd[fd] = NULL;
+}
+
+// Maps the file open as fd into memory at addr.  The pages are read in on
+// first touch; the last one is padded with zeros.
+mapid_t mmap(int fd, void *addr) {
+    struct thread *cur = thread_current();
+    struct mmap_file *mf;
+    off_t length;
+
+    // addr must be a page-aligned user address other than 0, and fd an
+    // open file that is not empty
+    if (addr == NULL || pg_ofs(addr) != 0 || fd < 3 || fd >= 128 || cur->fd[fd] == NULL) {
+        return MAP_FAILED;
+    }
+
+    mf = malloc(sizeof *mf);
+    if (mf == NULL) {
+        return MAP_FAILED;
+    }
+
+    // The mapping has its own opening, so it outlives close(fd)
+    lock_acquire(&filesys_lock);
+    mf->file = file_reopen(cur->fd[fd]);
+    length = mf->file != NULL ? file_length(mf->file) : 0;
+    lock_release(&filesys_lock);
+    if (length == 0) {
+        file_close(mf->file);
+        free(mf);
+        return MAP_FAILED;
+    }
+
+    // Describe the mapping by one VM_FILE region, failing if it would
+    // leave user space or overlap an existing mapping
+    mf->vma = malloc(sizeof *mf->vma);
+    if (mf->vma == NULL) {
+        file_close(mf->file);
+        free(mf);
+        return MAP_FAILED;
+    }
+    mf->vma->type = VM_FILE;
+    mf->vma->start = addr;
+    mf->vma->end = (uint8_t *)addr + ROUND_UP(length, PGSIZE);
+    mf->vma->writable = true;
+    mf->vma->file = mf->file;
+    mf->vma->offset = 0;
+    mf->vma->read_bytes = length;
+    if ((uint8_t *)mf->vma->end < (uint8_t *)addr
+        || !insert_vma(&cur->vma_list, mf->vma)) {
+        free(mf->vma);
+        file_close(mf->file);
+        free(mf);
+        return MAP_FAILED;
+    }
+
+    mf->mapid = cur->next_mapid++;
+    list_push_back(&cur->mmap_list, &mf->elem);
+    return mf->mapid;
+}
+
+// Unmaps the mapping mapid.  Pages that were modified are written back to
+// the file as their vm_entries go; the rest are simply dropped.
+void munmap(mapid_t mapping) {
+    struct thread *cur = thread_current();
+    struct mmap_file *mf = NULL;
+    struct list_elem *e;
+
+    for (e = list_begin(&cur->mmap_list); e != list_end(&cur->mmap_list); e = list_next(e)) {
+        if (list_entry(e, struct mmap_file, elem)->mapid == mapping) {
+            mf = list_entry(e, struct mmap_file, elem);
+            break;
+        }
+    }
+    if (mf == NULL) {
+        return;
+    }
+
+    delete_vma(&cur->vm, mf->vma);
+
+    list_remove(&mf->elem);
+    lock_acquire(&filesys_lock);
+    file_close(mf->file);
+    lock_release(&filesys_lock);
+    free(mf);
+}
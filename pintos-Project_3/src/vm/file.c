@@ -1,30 +1,186 @@
 #include "file.h"
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "filesys/inode.h"
+#include "userprog/pagedir.h"
+#include "vm/swap.h"
+#include "devices/timer.h"
 
 struct list lru_list; // LRU list
 struct lock lru_list_lock;
 struct list_elem *lru_clock;
 
-// Move the LRU clock to the next position in the clock algorithm
-static struct list_elem *get_next_lru_clock() {
-    struct list_elem *next_elem;
+// Shared all-zero frame, from the kernel pool.  Pages that have never been
+// written and hold only zeros are mapped to it read-only until their first
+// write, so that reading them costs no frame.
+void *zero_page;
+
+// Frame table: one struct page per frame of the user pool, indexed by the
+// frame's position in the pool, so a kernel address maps to its page in O(1)
+static struct page *frame_table;
+static size_t frame_cnt;        // Number of frames in the user pool
+static size_t free_frame_cnt;   // Number of those not in use, under lru_list_lock
+
+// Page-out daemon: woken when fewer than pageout_low frames are free, it
+// evicts with the clock until pageout_high frames are free again, so that
+// most faults find a frame ready instead of paying for an eviction
+static size_t pageout_low, pageout_high;
+static struct semaphore pageout_sema;
+static bool pageout_active;     // Daemon has been woken and is not done yet
+
+// Page cleaner: writes dirty frames back ahead of the clock hand and clears
+// their dirty bits, so that reclaim can usually just drop a clean frame
+#define PAGECLEAN_SCAN 32       // Frames examined ahead of the hand per run
+#define PAGECLEAN_MAX 8         // Frames written back per run
+static struct semaphore pageclean_sema;
+static bool pageclean_active;   // Cleaner has been woken and is not done yet
+
+// Working-set replacement.  A page referenced within the last WS_WINDOW
+// ticks belongs to its process's working set, and the clock passes over it
+// unless the process holds more frames than its resident set limit.  The
+// limit is rss_limit if set, or else an equal share of the frames among the
+// processes holding any.
+#define WS_WINDOW TIMER_FREQ
+static size_t rss_limit;        // SIZE_MAX for an equal share
+static size_t rss_thread_cnt;   // Threads with rss > 0, under lru_list_lock
+
+// Shared page table: frames caching file data, keyed by the file's inode,
+// the offset and the number of bytes read, and mapped into every process
+// using the data.  Pages holding a whole page of a file form the page cache,
+// through which inode_read_at() and inode_write_at() go and file mappings
+// are mapped, so file data is in memory once and always coherent.  Pages
+// cached from a partial page of an executable are freed once no process
+// maps them; executables are kept open with writes denied meanwhile, so
+// they never go stale.  Executable pages are mapped read-only until their
+// first write copies them.  Each inode also lists its pages in the table,
+// so they can be dropped without searching the frames.  Under lru_list_lock.
+static struct hash shared_pages;
+
+// Frames are written to swap or to their file without lru_list_lock, so
+// that other processes can fault in the meantime.  Such a frame is pinned
+// and its vm_entry marked io_pending; anyone who needs the vm_entry settled
+// waits on page_io_done, which is signalled when a write finishes.
+static struct condition page_io_done;
+
+static unsigned shared_page_hash(const struct hash_elem *e, void *aux UNUSED) {
+    struct page *page = hash_entry(e, struct page, share_elem);
+    return hash_bytes(&page->inode, sizeof page->inode) ^ hash_int(page->offset);
+}
+
+static bool shared_page_less(const struct hash_elem *a_, const struct hash_elem *b_,
+                             void *aux UNUSED) {
+    struct page *a = hash_entry(a_, struct page, share_elem);
+    struct page *b = hash_entry(b_, struct page, share_elem);
+
+    if (a->inode != b->inode)
+        return a->inode < b->inode;
+    if (a->offset != b->offset)
+        return a->offset < b->offset;
+    return a->read_bytes < b->read_bytes;
+}
+
+// VM statistics, printed at shutdown by vm_print_stats().  With vm_trace
+// set (kernel option -vmtrace), each fault and eviction is also logged as a
+// one-line record on the console.  Counters are updated under lru_list_lock,
+// except fault counts, which are approximate.
+bool vm_trace;
+static long long fault_cnt[3][2];       // Faults by vm_entry type, minor and major
+static long long evict_cnt;             // Frames reclaimed by the clock
+static long long writeback_cnt;         // Dirty pages written to swap or their file
+static long long clean_cnt;             // Of those, written ahead by the cleaner
+static long long sweep_cnt;             // Victim searches by the clock
+static long long sweep_len_total;       // Frames examined over all searches
+static long long sweep_len_max;         // Frames examined by the longest search
+static long long lru_lock_cnt;          // Acquisitions of lru_list_lock
+static uint64_t lru_lock_cycles;        // CPU cycles lru_list_lock was held for
+static uint64_t lru_lock_start;         // Time stamp of the current acquisition
+
+static const char *vm_type_name[] = {"bin", "file", "anon"};
+
+// Read the CPU's time-stamp counter
+static inline uint64_t rdtsc(void) {
+    uint64_t tsc;
+    asm volatile ("rdtsc" : "=A" (tsc));
+    return tsc;
+}
+
+// Acquire lru_list_lock, timing how long it is held
+static void lru_lock(void) {
+    lock_acquire(&lru_list_lock);
+    lru_lock_cnt++;
+    lru_lock_start = rdtsc();
+}
+
+static void lru_unlock(void) {
+    lru_lock_cycles += rdtsc() - lru_lock_start;
+    lock_release(&lru_list_lock);
+}
+
+// Wait on cond, which is paired with lru_list_lock
+static void lru_wait(struct condition *cond) {
+    lru_lock_cycles += rdtsc() - lru_lock_start;
+    cond_wait(cond, &lru_list_lock);
+    lru_lock_start = rdtsc();
+}
+
+// Count a page fault on vme's page, major if it had to wait for disk I/O
+void vm_count_fault(struct vm_entry *vme, bool major) {
+    fault_cnt[vme->type][major]++;
+    if (vm_trace)
+        printf("vm: fault tid=%d addr=%p type=%s %s\n", thread_current()->tid,
+               vme->vaddr, vm_type_name[vme->type], major ? "major" : "minor");
+}
 
+// Print VM statistics
+void vm_print_stats(void) {
+    long long minor = fault_cnt[VM_BIN][0] + fault_cnt[VM_FILE][0] + fault_cnt[VM_ANON][0];
+    long long major = fault_cnt[VM_BIN][1] + fault_cnt[VM_FILE][1] + fault_cnt[VM_ANON][1];
+
+    printf("VM: %lld minor faults, %lld major faults\n", minor, major);
+    printf("VM: bin %lld+%lld, file %lld+%lld, anon %lld+%lld faults (minor+major)\n",
+           fault_cnt[VM_BIN][0], fault_cnt[VM_BIN][1], fault_cnt[VM_FILE][0],
+           fault_cnt[VM_FILE][1], fault_cnt[VM_ANON][0], fault_cnt[VM_ANON][1]);
+    printf("VM: %lld evictions, %lld dirty writebacks (%lld by the cleaner)\n",
+           evict_cnt, writeback_cnt, clean_cnt);
+    printf("VM: %lld clock sweeps over %lld frames, longest %lld\n",
+           sweep_cnt, sweep_len_total, sweep_len_max);
+    printf("VM: lru_list_lock taken %lld times, held %llu cycles\n",
+           lru_lock_cnt, lru_lock_cycles);
+    swap_print_stats();
+}
+
+// Return the frame table entry for the user-pool frame at kaddr
+static struct page *kaddr_to_page(void *kaddr) {
+    return &frame_table[palloc_user_page_idx(kaddr)];
+}
+
+// Return the element after e in the LRU list, wrapping around at the end
+static struct list_elem *lru_next(struct list_elem *e) {
     // If the LRU list is empty
     if (list_empty(&lru_list))
         return NULL;
 
-    // If the LRU clock is NULL or at the end of the list, set it to the beginning
-    if (lru_clock == NULL || lru_clock == list_end(&lru_list))
+    // If e is NULL or at the end of the list, set it to the beginning
+    if (e == NULL || e == list_end(&lru_list))
         return list_begin(&lru_list);
 
     // If there is no next element, i.e., at the end of the list, set it to the beginning
-    if (list_next(lru_clock) == list_end(&lru_list)) {
+    if (list_next(e) == list_end(&lru_list)) {
         return list_begin(&lru_list);
     } else {
         // If there is a next element, return it
-        return list_next(lru_clock);
+        return list_next(e);
     }
 }
 
+// Move the LRU clock to the next position in the clock algorithm
+static struct list_elem *get_next_lru_clock(void) {
+    return lru_next(lru_clock);
+}
+
 // Initialize data structures related to LRU
 void lru_list_init(void) {
     // Initialize the LRU list
@@ -33,6 +189,280 @@ void lru_list_init(void) {
     lock_init(&lru_list_lock);
     // Set the LRU clock to NULL
     lru_clock = NULL;
+
+    // Build the frame table alongside the user pool, from the kernel pool
+    frame_cnt = palloc_user_page_cnt();
+    free_frame_cnt = frame_cnt;
+    frame_table = palloc_get_multiple(PAL_ASSERT | PAL_ZERO,
+                                      DIV_ROUND_UP(frame_cnt * sizeof *frame_table, PGSIZE));
+
+    zero_page = palloc_get_page(PAL_ASSERT | PAL_ZERO);
+    hash_init(&shared_pages, shared_page_hash, shared_page_less, NULL);
+    cond_init(&page_io_done);
+}
+
+// Unpin page, waking page_cache_drop() if it waits for the page.  The
+// caller holds lru_list_lock.
+static void unpin_page(struct page *page) {
+    ASSERT(page->pin_cnt > 0);
+    if (--page->pin_cnt == 0)
+        cond_broadcast(&page_io_done, &lru_list_lock);
+}
+
+// Return true if page belongs to the page cache, which keeps pages after
+// their last sharer goes, rather than holding a partial executable page
+static bool is_page_cache_page(struct page *page) {
+    return page->read_bytes == PGSIZE;
+}
+
+// Free the shared page if no process maps or pins it, unless cached is
+// true and the page cache keeps it.  The caller holds lru_list_lock.
+static void release_shared_page(struct page *page, bool cached) {
+    if (list_empty(&page->sharers) && page->pin_cnt == 0
+        && !(cached && is_page_cache_page(page)))
+        _free_page(page);
+}
+
+// Return true if any process mapping the shared page has modified it
+static bool shared_page_dirty(struct page *page) {
+    struct list_elem *e;
+
+    for (e = list_begin(&page->sharers); e != list_end(&page->sharers); e = list_next(e)) {
+        struct vm_entry *vme = list_entry(e, struct vm_entry, share_elem);
+        if (pagedir_is_dirty(vme->thread->pagedir, vme->vaddr))
+            return true;
+    }
+    return false;
+}
+
+// Return true if evicting page would require writing it somewhere first
+static bool page_needs_writeback(struct page *page) {
+    if (page->shared)
+        return shared_page_dirty(page);
+
+    struct vm_entry *vme = page->vme;
+    bool dirty = pagedir_is_dirty(page->thread->pagedir, vme->vaddr);
+
+    // An anonymous page can be dropped only if a clean copy sits in swap
+    if (vme->type == VM_ANON)
+        return dirty || vme->swap_slot == SWAP_NONE;
+    return dirty;
+}
+
+// Return true if the shared page is dirty in some process and neither
+// pinned nor accessed in any.  The caller holds lru_list_lock.
+static bool shared_page_is_cleanable(struct page *page) {
+    struct list_elem *e;
+    bool dirty = false;
+
+    for (e = list_begin(&page->sharers); e != list_end(&page->sharers); e = list_next(e)) {
+        struct vm_entry *vme = list_entry(e, struct vm_entry, share_elem);
+        uint32_t *pd = vme->thread->pagedir;
+
+        if (vme->pinned || pagedir_is_accessed(pd, vme->vaddr))
+            return false;
+        if (pagedir_is_dirty(pd, vme->vaddr))
+            dirty = true;
+    }
+    return dirty;
+}
+
+// Return true if page is dirty and not in use, so that the cleaner should
+// write it back.  The caller holds lru_list_lock.
+static bool page_is_cleanable(struct page *page) {
+    struct vm_entry *vme = page->vme;
+
+    if (page->pin_cnt > 0)
+        return false;
+    if (page->shared)
+        return shared_page_is_cleanable(page);
+    if (vme == NULL || vme->pinned)
+        return false;
+
+    uint32_t *pd = page->thread->pagedir;
+    return !pagedir_is_accessed(pd, vme->vaddr) && pagedir_is_dirty(pd, vme->vaddr);
+}
+
+// Clear the dirty bits of every process mapping the shared page, along with
+// their TLB entries.  The caller holds lru_list_lock.
+static void shared_page_clear_dirty(struct page *page) {
+    struct list_elem *e;
+
+    for (e = list_begin(&page->sharers); e != list_end(&page->sharers); e = list_next(e)) {
+        struct vm_entry *vme = list_entry(e, struct vm_entry, share_elem);
+        pagedir_set_dirty(vme->thread->pagedir, vme->vaddr, false);
+    }
+}
+
+// Body of the page cleaner thread.  Each run writes back up to PAGECLEAN_MAX
+// dirty frames among the next PAGECLEAN_SCAN frames the clock hand will
+// reach, so that they can later be evicted without I/O.  The frames stay
+// mapped; their dirty bits are cleared before the write, so a store that
+// races with the write marks the page dirty again.  Shared pages are file
+// mappings, since executable data is mapped read-only, and go back to their
+// file; the pin keeps the inode alive, as in write_shared_page().  Private
+// pages are executable or anonymous pages, so they go to swap, and the swap
+// copy stays valid while they stay clean.
+static void pageclean_daemon(void *aux UNUSED) {
+    for (;;) {
+        struct page *batch[PAGECLEAN_MAX];
+        size_t slots[PAGECLEAN_MAX];
+        struct list_elem *e;
+        size_t scanned, cnt = 0, i;
+
+        sema_down(&pageclean_sema);
+
+        // Pick and pin the frames to write
+        lru_lock();
+        e = lru_clock;
+        for (scanned = 0; scanned < PAGECLEAN_SCAN && cnt < PAGECLEAN_MAX; scanned++) {
+            e = lru_next(e);
+            if (e == NULL)
+                break;
+            struct page *page = list_entry(e, struct page, lru);
+            if (page_is_cleanable(page)) {
+                page->pin_cnt++;
+                if (page->shared)
+                    shared_page_clear_dirty(page);
+                else {
+                    page->vme->io_pending = true;
+                    pagedir_set_dirty(page->thread->pagedir, page->vme->vaddr, false);
+                }
+                batch[cnt++] = page;
+            }
+        }
+        lru_unlock();
+
+        for (i = 0; i < cnt; i++) {
+            if (batch[i]->shared)
+                inode_write_page(batch[i]->inode, batch[i]->offset, batch[i]->kaddr);
+            else
+                slots[i] = swap_out(batch[i]->kaddr);
+        }
+
+        lru_lock();
+        for (i = 0; i < cnt; i++) {
+            struct vm_entry *vme = batch[i]->vme;
+            if (batch[i]->shared) {
+                unpin_page(batch[i]);
+                release_shared_page(batch[i], true);
+                continue;
+            }
+            if (vme->swap_slot != SWAP_NONE)
+                swap_free(vme->swap_slot);
+            vme->swap_slot = slots[i];
+            vme->type = VM_ANON;
+            vme->io_pending = false;
+            batch[i]->pin_cnt--;
+        }
+        writeback_cnt += cnt;
+        clean_cnt += cnt;
+        if (cnt > 0)
+            cond_broadcast(&page_io_done, &lru_list_lock);
+        pageclean_active = false;
+        lru_unlock();
+    }
+}
+
+// Wake the page cleaner unless it is already running.  The caller holds
+// lru_list_lock.
+static void pageclean_wakeup(void) {
+    if (!pageclean_active) {
+        pageclean_active = true;
+        sema_up(&pageclean_sema);
+    }
+}
+
+// Body of the page-out daemon thread
+static void pageout_daemon(void *aux UNUSED) {
+    for (;;) {
+        sema_down(&pageout_sema);
+
+        // Evict one victim at a time, so that faulting processes can take
+        // the frames as they become free
+        for (;;) {
+            bool done;
+
+            lru_lock();
+            done = free_frame_cnt >= pageout_high || list_empty(&lru_list);
+            if (done)
+                pageout_active = false;
+            lru_unlock();
+            if (done)
+                break;
+            try_to_free_pages(PAL_USER);
+        }
+    }
+}
+
+// Start the page-out daemon with the given free-frame watermarks.  SIZE_MAX
+// selects a default: LOW is 1/32 of the user pool and HIGH twice LOW.
+// A LOW of 0 leaves all eviction to alloc_page().
+void pageout_init(size_t low, size_t high) {
+    if (low == SIZE_MAX)
+        low = frame_cnt / 32;
+    if (high == SIZE_MAX)
+        high = low * 2;
+    if (high < low)
+        high = low;
+    if (high > frame_cnt)
+        high = frame_cnt;
+
+    pageout_low = low;
+    pageout_high = high;
+    pageout_active = false;
+    sema_init(&pageout_sema, 0);
+    pageclean_active = false;
+    sema_init(&pageclean_sema, 0);
+
+    if (pageout_low > 0)
+        thread_create("pageout", PRI_DEFAULT, pageout_daemon, NULL);
+    thread_create("pageclean", PRI_DEFAULT, pageclean_daemon, NULL);
+}
+
+// Set the resident set limit; SIZE_MAX gives each process an equal share
+void rss_limit_init(size_t limit) {
+    rss_limit = limit;
+}
+
+// Return true if thread t holds more frames than it is entitled to.  The
+// caller holds lru_list_lock.
+static bool rss_over_limit(struct thread *t) {
+    size_t limit = rss_limit;
+
+    if (limit == SIZE_MAX)
+        limit = frame_cnt / (rss_thread_cnt > 0 ? rss_thread_cnt : 1);
+    return t->rss > limit;
+}
+
+// Charge or credit a frame to thread t.  The caller holds lru_list_lock.
+static void rss_charge(struct thread *t) {
+    if (t->rss++ == 0)
+        rss_thread_cnt++;
+}
+
+static void rss_uncharge(struct thread *t) {
+    ASSERT(t->rss > 0);
+    if (--t->rss == 0)
+        rss_thread_cnt--;
+}
+
+// Return true if page has been referenced within WS_WINDOW ticks of now
+static bool page_in_working_set(struct page *page, int64_t now) {
+    return now - page->last_used < WS_WINDOW;
+}
+
+// Wake the page-out daemon if free frames have fallen below the low
+// watermark, and the cleaner as soon as they fall below the high one, so
+// that frames are clean by the time the daemon reaches them.  The caller
+// holds lru_list_lock.
+static void pageout_wakeup(void) {
+    if (free_frame_cnt < pageout_high)
+        pageclean_wakeup();
+    if (free_frame_cnt < pageout_low && !pageout_active) {
+        pageout_active = true;
+        sema_up(&pageout_sema);
+    }
 }
 
 // Add a user page to the end of the LRU list
@@ -50,98 +480,307 @@ void del_page_from_lru_list(struct page *page) {
     list_remove(&page->lru);
 }
 
-// Try to free pages using the clock algorithm when facing a memory shortage
-void try_to_free_pages(enum palloc_flags flags) {
+// Return the resident page of thread t mapped at upage if it can be swapped
+// out together with a victim: an anonymous (or dirty executable) page that
+// is not pinned and has not been accessed recently
+static struct page *cluster_candidate(struct thread *t, void *upage) {
+    if (!is_user_vaddr(upage))
+        return NULL;
+
+    void *kaddr = pagedir_get_page(t->pagedir, upage);
+    if (kaddr == NULL || kaddr == zero_page)
+        return NULL;
+
+    struct page *page = kaddr_to_page(kaddr);
+    struct vm_entry *vme = page->vme;
+    if (vme == NULL || page->thread != t || vme->pinned || page->pin_cnt > 0
+        || pagedir_is_accessed(t->pagedir, upage))
+        return NULL;
+
+    if (page_needs_writeback(page))
+        return page;
+    return NULL;
+}
+
+// Collect into cluster[] the run of swappable pages of the victim's process
+// around the victim, in address order, and return its length.  Pages above
+// the victim are taken first, since processes mostly walk memory upward.
+static size_t gather_swap_cluster(struct page *victim, struct page *cluster[]) {
+    struct thread *t = victim->thread;
+    uint8_t *vaddr = victim->vme->vaddr;
+    struct page *above[SWAP_CLUSTER - 1], *below[SWAP_CLUSTER - 1];
+    size_t above_cnt = 0, below_cnt = 0, cnt = 0, i;
+    struct page *page;
+
+    while (1 + above_cnt < SWAP_CLUSTER
+           && (page = cluster_candidate(t, vaddr + (above_cnt + 1) * PGSIZE)) != NULL)
+        above[above_cnt++] = page;
+    while (1 + above_cnt + below_cnt < SWAP_CLUSTER
+           && (uintptr_t) vaddr > (below_cnt + 1) * PGSIZE
+           && (page = cluster_candidate(t, vaddr - (below_cnt + 1) * PGSIZE)) != NULL)
+        below[below_cnt++] = page;
+
+    for (i = below_cnt; i > 0; i--)
+        cluster[cnt++] = below[i - 1];
+    cluster[cnt++] = victim;
+    for (i = 0; i < above_cnt; i++)
+        cluster[cnt++] = above[i];
+    return cnt;
+}
+
+// Swap out the victim page together with its neighbouring swappable pages,
+// into adjacent swap slots when possible, and free all of them.  The pages
+// are unmapped and pinned, and written without lru_list_lock; their owner
+// waits in wait_page_io() if it faults on one of them meanwhile.  Called
+// and returns with lru_list_lock held.
+static void swap_out_victim(struct page *victim) {
+    struct page *cluster[SWAP_CLUSTER];
+    void *kaddrs[SWAP_CLUSTER];
+    size_t slots[SWAP_CLUSTER];
+    size_t cnt, i;
+
+    cnt = gather_swap_cluster(victim, cluster);
+    for (i = 0; i < cnt; i++) {
+        struct page *page = cluster[i];
+        page->pin_cnt++;
+        page->vme->io_pending = true;
+        pagedir_clear_page(page->thread->pagedir, page->vme->vaddr);
+        kaddrs[i] = page->kaddr;
+    }
+
+    lru_unlock();
+    swap_out_cluster(kaddrs, slots, cnt);
+    lru_lock();
+
+    writeback_cnt += cnt;
+    evict_cnt += cnt - 1;
+    for (i = 0; i < cnt; i++) {
+        struct vm_entry *vme = cluster[i]->vme;
+        // Any older swap copy of the page is stale now
+        if (vme->swap_slot != SWAP_NONE)
+            swap_free(vme->swap_slot);
+        vme->swap_slot = slots[i];
+        vme->type = VM_ANON;
+        vme->is_loaded = false;
+        vme->io_pending = false;
+        cluster[i]->pin_cnt--;
+        _free_page(cluster[i]);
+    }
+    cond_broadcast(&page_io_done, &lru_list_lock);
+}
+
+// Return true if any process mapping the shared page has referenced it since
+// the last check, clearing the accessed bits with their TLB entries left to
+// batch, or has it pinned
+static bool shared_page_referenced(struct page *page, struct tlb_batch *batch) {
+    struct list_elem *e;
+    bool referenced = false;
+
+    for (e = list_begin(&page->sharers); e != list_end(&page->sharers); e = list_next(e)) {
+        struct vm_entry *vme = list_entry(e, struct vm_entry, share_elem);
+        uint32_t *pd = vme->thread->pagedir;
+
+        if (vme->pinned || pagedir_is_accessed(pd, vme->vaddr))
+            referenced = true;
+        pagedir_clear_accessed(pd, vme->vaddr, batch);
+    }
+    return referenced;
+}
+
+// Write the shared page back to its file without lru_list_lock, keeping
+// the page pinned meanwhile.  The pin also keeps the inode alive: if the
+// last process using the file unmaps and closes it, inode_close() waits in
+// page_cache_drop() for the write to finish.  The page is then released as
+// by release_shared_page(), so it may be gone on return.  Called and
+// returns with lru_list_lock held.
+static void write_shared_page(struct page *page, bool cached) {
+    page->pin_cnt++;
+    lru_unlock();
+    inode_write_page(page->inode, page->offset, page->kaddr);
+    lru_lock();
+    unpin_page(page);
+    writeback_cnt++;
+    release_shared_page(page, cached);
+}
+
+// Evict the shared page, writing it back to its file first if a process
+// modified it through a file mapping.  The page is unmapped everywhere and
+// written without lru_list_lock.  A sharer that touches it again meanwhile
+// finds it in the shared page table and maps it anew, and then the page is
+// kept.  Called and returns with lru_list_lock held.
+static void evict_shared_page(struct page *page) {
+    bool dirty = shared_page_dirty(page);
+
+    while (!list_empty(&page->sharers)) {
+        struct vm_entry *vme = list_entry(list_pop_front(&page->sharers),
+                                          struct vm_entry, share_elem);
+        pagedir_clear_page(vme->thread->pagedir, vme->vaddr);
+        vme->is_loaded = false;
+    }
+
+    if (dirty)
+        write_shared_page(page, false);
+    else
+        release_shared_page(page, false);
+}
+
+// Try to free pages using the clock algorithm when facing a memory shortage.
+// lru_list_lock is held only while choosing the victim; any write-back
+// happens without it.
+void try_to_free_pages(enum palloc_flags flags UNUSED) {
     struct page *page;
     struct page *victim;
+    size_t lru_len;
+    int64_t now = timer_ticks();
+    size_t scanned;
+    struct tlb_batch batch;
 
-    lru_clock = get_next_lru_clock();
+    pagedir_batch_init(&batch);
+    lru_lock();
+    lru_len = frame_cnt - free_frame_cnt;
 
-    // Choose a victim page using the clock algorithm
-    page = list_entry(lru_clock, struct page, lru);
+    // Choose a victim page using the clock algorithm (WSClock).  Pages that
+    // are still being set up (no vm_entry yet) or pinned are skipped, and
+    // referenced pages get their last_used time stamped.  For the first two
+    // revolutions, pages in the working set of a process within its limit
+    // are passed over, and during the first one, pages that would need
+    // writing back are passed over too and left to the cleaner.  So a clean
+    // page outside the working sets is taken if there is one, then a dirty
+    // one, and only then any page at all.  The TLB entries of the accessed
+    // bits cleared on the way are flushed together at the end of the sweep.
+    for (scanned = 0; ; scanned++) {
+        // If every frame is pinned or being written, let their users finish
+        if (list_empty(&lru_list) || scanned > 3 * lru_len) {
+            pagedir_batch_flush(&batch);
+            lru_unlock();
+            thread_yield();
+            return;
+        }
 
-    // Iterate until a suitable victim page is found
-    while (page->vme->pinned || pagedir_is_accessed(page->thread->pagedir, page->vme->vaddr)) {
-        pagedir_set_accessed(page->thread->pagedir, page->vme->vaddr, false);
         lru_clock = get_next_lru_clock();
         page = list_entry(lru_clock, struct page, lru);
+
+        if (page->shared) {
+            if (page->pin_cnt > 0 || shared_page_referenced(page, &batch)) {
+                page->last_used = now;
+                continue;
+            }
+        } else {
+            if (page->vme == NULL || page->vme->pinned || page->pin_cnt > 0)
+                continue;
+            if (pagedir_is_accessed(page->thread->pagedir, page->vme->vaddr)) {
+                pagedir_clear_accessed(page->thread->pagedir, page->vme->vaddr, &batch);
+                page->last_used = now;
+                continue;
+            }
+        }
+        if (scanned < 2 * lru_len && page_in_working_set(page, now)
+            && (page->shared || !rss_over_limit(page->thread)))
+            continue;
+        if (scanned < lru_len && page_needs_writeback(page)) {
+            pageclean_wakeup();
+            continue;
+        }
+        break;
     }
+    pagedir_batch_flush(&batch);
 
     // Victim page identified
     victim = page;
+    evict_cnt++;
+    sweep_cnt++;
+    sweep_len_total += scanned + 1;
+    if ((long long) scanned + 1 > sweep_len_max)
+        sweep_len_max = scanned + 1;
+    if (vm_trace) {
+        if (victim->shared)
+            printf("vm: evict shared ofs=%zu sweep=%zu\n", victim->offset, scanned + 1);
+        else
+            printf("vm: evict tid=%d addr=%p type=%s sweep=%zu\n", victim->thread->tid,
+                   victim->vme->vaddr, vm_type_name[victim->vme->type], scanned + 1);
+    }
 
-    // Handle the victim based on its type (VM_BIN, VM_FILE, VM_ANON)
-    switch (victim->vme->type) {
-        case VM_BIN:
-            if (pagedir_is_dirty(victim->thread->pagedir, victim->vme->vaddr)) {
-                victim->vme->swap_slot = swap_out(victim->kaddr);
-                victim->vme->type = VM_ANON;
-            }
-            break;
-        case VM_FILE:
-            if (pagedir_is_dirty(victim->thread->pagedir, victim->vme->vaddr)) {
-                file_write_at(victim->vme->file, victim->vme->vaddr, victim->vme->read_bytes, victim->vme->offset);
-            }
-            break;
-        case VM_ANON:
-            victim->vme->swap_slot = swap_out(victim->kaddr);
-            break;
+    if (victim->shared)
+        evict_shared_page(victim);
+    else if (page_needs_writeback(victim)) {
+        // Private pages are executable or anonymous pages, since mapped
+        // files live in the page cache, and go to swap
+        swap_out_victim(victim);
+    } else {
+        // Mark the page as not loaded in memory and free it
+        victim->vme->is_loaded = false;
+        _free_page(victim);
     }
+    lru_unlock();
+}
 
-    // Mark the page as not loaded in memory
-    victim->vme->is_loaded = false;
+// Initialize the frame table entry for the newly allocated frame kpage and
+// put it on the LRU list.  The caller holds lru_list_lock.
+static struct page *init_page(void *kpage) {
+    struct page *page = kaddr_to_page(kpage);
+    page->kaddr = kpage;
+    page->vme = NULL;
+    page->thread = thread_current();
+    page->last_used = timer_ticks();
+    page->pin_cnt = 0;
+    rss_charge(page->thread);
+    free_frame_cnt--;
+
+    // Add the page to the LRU list
+    add_page_to_lru_list(page);
 
-    // Free the victim page
-    _free_page(victim);
+    // Start refilling the free frames in the background if they run low
+    pageout_wakeup();
+
+    return page;
 }
 
-// Allocate a new physical page
+// Allocate a new physical page, evicting pages until a frame comes free
 struct page *alloc_page(enum palloc_flags flags) {
-    lock_acquire(&lru_list_lock);
-
-    // Allocate a new page using palloc_get_page()
-    uint8_t *kpage = palloc_get_page(flags);
+    uint8_t *kpage;
+    struct page *page;
 
-    // Retry allocation until successful
-    while (kpage == NULL) {
+    while ((kpage = palloc_get_page(flags)) == NULL)
         try_to_free_pages(flags);
-        kpage = palloc_get_page(flags);
-    }
 
-    // Create and initialize a new page structure
-    struct page *page = malloc(sizeof(struct page));
-    page->kaddr = kpage;
-    page->thread = thread_current();
+    lru_lock();
+    page = init_page(kpage);
+    lru_unlock();
 
-    // Add the page to the LRU list
-    add_page_to_lru_list(page);
+    return page;
+}
 
-    lock_release(&lru_list_lock);
+// Allocate a new physical page only if a frame is free, without evicting
+// anything.  Returns NULL if the user pool is exhausted.
+struct page *alloc_page_nowait(enum palloc_flags flags) {
+    struct page *page = NULL;
+
+    lru_lock();
+
+    uint8_t *kpage = palloc_get_page(flags);
+    if (kpage != NULL)
+        page = init_page(kpage);
+
+    lru_unlock();
 
     return page;
 }
 
 // Free a physical page
 void free_page(void *kaddr) {
-    lock_acquire(&lru_list_lock);
+    // Pages that were never loaded, or only mapped to the zero page, have
+    // no frame
+    if (kaddr == NULL || kaddr == zero_page)
+        return;
 
-    // Find the page in the LRU list using its kernel address
-    struct list_elem *e;
-    struct page *page = NULL;
-
-    for (e = list_begin(&lru_list); e != list_end(&lru_list); e = list_next(e)) {
-        struct page *candidate_page = list_entry(e, struct page, lru);
-        if (candidate_page->kaddr == kaddr) {
-            page = candidate_page;
-            break;
-        }
-    }
+    lru_lock();
 
-    // If the page is found, free it
-    if (page != NULL)
+    // Look the page up in the frame table; free it if it is in use
+    struct page *page = kaddr_to_page(kaddr);
+    if (page->kaddr != NULL)
         _free_page(page);
 
-    lock_release(&lru_list_lock);
+    lru_unlock();
 }
 
 // Internal function to free a physical page
@@ -149,8 +788,331 @@ void _free_page(struct page *page) {
     // Remove the page from the LRU list
     del_page_from_lru_list(page);
 
-    // Clear the page table entry and free the allocated memory
-    pagedir_clear_page(page->thread->pagedir, pg_round_down(page->vme->vaddr));
+    // Clear the page table entries and release the frame
+    if (page->shared) {
+        while (!list_empty(&page->sharers)) {
+            struct vm_entry *vme = list_entry(list_pop_front(&page->sharers),
+                                              struct vm_entry, share_elem);
+            pagedir_clear_page(vme->thread->pagedir, vme->vaddr);
+            vme->is_loaded = false;
+        }
+        hash_delete(&shared_pages, &page->share_elem);
+        list_remove(&page->inode_elem);
+        page->shared = false;
+    } else if (page->vme != NULL)
+        pagedir_clear_page(page->thread->pagedir, pg_round_down(page->vme->vaddr));
     palloc_free_page(page->kaddr);
-    free(page);
+
+    // Mark the frame table entry unused
+    if (page->thread != NULL)
+        rss_uncharge(page->thread);
+    free_frame_cnt++;
+    page->kaddr = NULL;
+    page->vme = NULL;
+    page->thread = NULL;
+}
+
+// Return the shared page holding read_bytes bytes of inode's data at offset,
+// or NULL if there is none.  The caller holds lru_list_lock.
+static struct page *shared_page_find(struct inode *inode, off_t offset, size_t read_bytes) {
+    struct page key;
+    struct hash_elem *e;
+
+    key.inode = inode;
+    key.offset = offset;
+    key.read_bytes = read_bytes;
+    e = hash_find(&shared_pages, &key.share_elem);
+    return e != NULL ? hash_entry(e, struct page, share_elem) : NULL;
+}
+
+// Return the number of bytes of file data in the shared page that vme maps.
+// Mapped files use the page cache, whose pages always hold a whole page of
+// the file.
+static size_t vme_share_bytes(struct vm_entry *vme) {
+    return vme->type == VM_FILE ? PGSIZE : vme->read_bytes;
+}
+
+// Return the shared page holding vme's data, or NULL if there is none.  The
+// caller holds lru_list_lock.
+static struct page *shared_page_lookup(struct vm_entry *vme) {
+    return shared_page_find(file_get_inode(vme->file), vme->offset, vme_share_bytes(vme));
+}
+
+// Enter page, holding read_bytes bytes of inode's data at offset, into the
+// shared page table.  Shared frames belong to no single process.  The
+// caller holds lru_list_lock.
+static void shared_page_publish(struct page *page, struct inode *inode, off_t offset,
+                                size_t read_bytes) {
+    page->inode = inode;
+    page->offset = offset;
+    page->read_bytes = read_bytes;
+    page->pin_cnt = 0;
+    list_init(&page->sharers);
+    hash_insert(&shared_pages, &page->share_elem);
+    list_push_back(inode_pages(inode), &page->inode_elem);
+    rss_uncharge(page->thread);
+    page->thread = NULL;
+    page->shared = true;
+}
+
+// Map the shared page at vme's address in the current process, writable
+// only for a writable file mapping; other pages are copied on write.  The
+// caller holds lru_list_lock.
+static bool shared_page_attach(struct page *page, struct vm_entry *vme) {
+    bool writable = vme->type == VM_FILE && vme->writable;
+
+    if (!pagedir_set_page(thread_current()->pagedir, vme->vaddr, page->kaddr, writable))
+        return false;
+    list_push_back(&page->sharers, &vme->share_elem);
+    vme->is_loaded = true;
+    page->last_used = timer_ticks();
+    return true;
+}
+
+// Unmap the shared page from vme's address, writing the page back to its
+// file if vme modified it.  A page that no process maps any more is freed,
+// unless the page cache keeps it.  Called and returns with lru_list_lock
+// held, but the write happens without it, as in write_shared_page().
+static void shared_page_detach(struct page *page, struct vm_entry *vme) {
+    uint32_t *pd = vme->thread->pagedir;
+    bool dirty = pagedir_is_dirty(pd, vme->vaddr);
+
+    list_remove(&vme->share_elem);
+    pagedir_clear_page(pd, vme->vaddr);
+    vme->is_loaded = false;
+    if (dirty)
+        write_shared_page(page, true);
+    else
+        release_shared_page(page, true);
+}
+
+// Return the shared page mapped at vme's address in the current process, or
+// NULL if vme's page is private.  The caller holds lru_list_lock.
+static struct page *shared_page_mapped(struct vm_entry *vme) {
+    void *kaddr = pagedir_get_page(thread_current()->pagedir, vme->vaddr);
+    struct page *page;
+
+    if (kaddr == NULL || kaddr == zero_page)
+        return NULL;
+    page = kaddr_to_page(kaddr);
+    return page->shared ? page : NULL;
+}
+
+// Return the page cache page holding the page of inode's data at the
+// page-aligned offset, reading it in if it is not cached yet, in which case
+// *read_in is set to true.  Returns with lru_list_lock held.
+static struct page *page_cache_get(struct inode *inode, off_t offset, bool *read_in) {
+    struct page *page, *new;
+
+    lru_lock();
+    page = shared_page_find(inode, offset, PGSIZE);
+    *read_in = page == NULL;
+    if (page != NULL)
+        return page;
+    lru_unlock();
+
+    // Read the page in without the lock; the clock passes over the new frame
+    // since it has no vm_entry
+    new = alloc_page(PAL_USER);
+    inode_read_page(inode, offset, new->kaddr);
+
+    // Another thread may have read the same page meanwhile
+    lru_lock();
+    page = shared_page_find(inode, offset, PGSIZE);
+    if (page == NULL) {
+        page = new;
+        shared_page_publish(page, inode, offset, PGSIZE);
+    } else
+        _free_page(new);
+    return page;
+}
+
+// Copy size bytes of inode's data at offset, which must not cross a page
+// boundary, out of the page cache into buffer, reading the page in first if
+// needed.  The page is pinned rather than locked during the copy, since
+// buffer may be a user buffer that faults.
+void page_cache_read(struct inode *inode, off_t offset, void *buffer, size_t size) {
+    off_t page_ofs = offset - offset % PGSIZE;
+    bool read_in;
+    struct page *page = page_cache_get(inode, page_ofs, &read_in);
+
+    ASSERT(offset % PGSIZE + size <= PGSIZE);
+
+    page->pin_cnt++;
+    page->last_used = timer_ticks();
+    lru_unlock();
+
+    memcpy(buffer, (uint8_t *)page->kaddr + (offset - page_ofs), size);
+
+    lru_lock();
+    unpin_page(page);
+    lru_unlock();
+}
+
+// Update the page cache after size bytes from buffer were written to inode
+// at offset, which must not cross a page boundary.  Pages that are not
+// cached are left alone, since the data is on disk already.
+void page_cache_write(struct inode *inode, off_t offset, const void *buffer, size_t size) {
+    off_t page_ofs = offset - offset % PGSIZE;
+    struct page *page;
+
+    ASSERT(offset % PGSIZE + size <= PGSIZE);
+
+    lru_lock();
+    page = shared_page_find(inode, page_ofs, PGSIZE);
+    if (page != NULL) {
+        page->pin_cnt++;
+        page->last_used = timer_ticks();
+    }
+    lru_unlock();
+    if (page == NULL)
+        return;
+
+    memcpy((uint8_t *)page->kaddr + (offset - page_ofs), buffer, size);
+
+    lru_lock();
+    unpin_page(page);
+    lru_unlock();
+}
+
+// Drop the cached pages of inode, which is being closed by its last opener.
+// No process maps them, since mappings keep their files open, but a page
+// may still be pinned by a copy in progress, which is waited for.
+void page_cache_drop(struct inode *inode) {
+    struct list *pages = inode_pages(inode);
+
+    lru_lock();
+    while (!list_empty(pages)) {
+        struct page *page = list_entry(list_front(pages), struct page, inode_elem);
+        if (page->pin_cnt > 0) {
+            lru_wait(&page_io_done);
+            continue;
+        }
+        ASSERT(list_empty(&page->sharers));
+        _free_page(page);
+    }
+    lru_unlock();
+}
+
+// Map vme's page of a mapped file from the page cache, reading it in if it
+// is not cached yet, in which case *read_in is set to true.  Returns true if
+// the page is now mapped.
+bool map_cached_page(struct vm_entry *vme, bool *read_in) {
+    struct page *page = page_cache_get(file_get_inode(vme->file), vme->offset, read_in);
+    bool success = shared_page_attach(page, vme);
+
+    lru_unlock();
+    return success;
+}
+
+// Map vme's page from the shared page table if another process already has
+// it in memory.  Returns true if the page is now mapped.
+bool map_shared_page(struct vm_entry *vme) {
+    struct page *page;
+    bool success = false;
+
+    lru_lock();
+    page = shared_page_lookup(vme);
+    if (page != NULL)
+        success = shared_page_attach(page, vme);
+    lru_unlock();
+
+    return success;
+}
+
+// Return true if the shared page table holds vme's data, which need not be
+// an entry of any process's table
+bool shared_page_cached(struct vm_entry *vme) {
+    bool cached;
+
+    lru_lock();
+    cached = shared_page_lookup(vme) != NULL;
+    lru_unlock();
+
+    return cached;
+}
+
+// Enter page, just loaded with vme's data from the executable, into the
+// shared page table and map it read-only at vme's address.  If another
+// process entered the same data meanwhile, page is freed and that one is
+// mapped instead.  Returns true if the page is now mapped.
+bool add_shared_page(struct page *page, struct vm_entry *vme) {
+    struct page *shared;
+    bool success;
+
+    lru_lock();
+    shared = shared_page_lookup(vme);
+    if (shared == NULL) {
+        shared = page;
+        shared_page_publish(shared, file_get_inode(vme->file), vme->offset,
+                            vme_share_bytes(vme));
+    } else
+        _free_page(page);
+
+    success = shared_page_attach(shared, vme);
+    if (!success && list_empty(&shared->sharers) && !is_page_cache_page(shared))
+        _free_page(shared);
+    lru_unlock();
+
+    return success;
+}
+
+// Wait until no write of vme's page is in progress, so that vme describes
+// where the page's data is.  The caller holds lru_list_lock.
+static void wait_io_locked(struct vm_entry *vme) {
+    while (vme->io_pending)
+        lru_wait(&page_io_done);
+}
+
+// Wait until no write of vme's page is in progress
+void wait_page_io(struct vm_entry *vme) {
+    lru_lock();
+    wait_io_locked(vme);
+    lru_unlock();
+}
+
+// Unmap vme's page from the current process and free its frame, unless it
+// is the zero page or a frame that the shared page table keeps.  The page
+// is looked up under lru_list_lock, so that the clock cannot take the frame
+// in between.
+void unmap_vme_page(struct vm_entry *vme) {
+    uint32_t *pd = thread_current()->pagedir;
+    void *kaddr;
+
+    lru_lock();
+    wait_io_locked(vme);
+    if (vme->is_loaded) {
+        kaddr = pagedir_get_page(pd, vme->vaddr);
+        if (kaddr == zero_page) {
+            pagedir_clear_page(pd, vme->vaddr);
+            vme->is_loaded = false;
+        } else if (kaddr != NULL) {
+            struct page *page = kaddr_to_page(kaddr);
+            if (page->shared)
+                shared_page_detach(page, vme);
+            else {
+                vme->is_loaded = false;
+                _free_page(page);
+            }
+        }
+    }
+    lru_unlock();
+}
+
+// Break copy-on-write sharing of vme's page: copy the shared page mapped at
+// vme's address into the private frame at kaddr and unmap the shared page.
+// Returns false, copying nothing, if vme's page is not mapped shared, as
+// happens if it was evicted meanwhile.
+bool copy_shared_page(struct vm_entry *vme, void *kaddr) {
+    struct page *page;
+
+    lru_lock();
+    page = shared_page_mapped(vme);
+    if (page != NULL) {
+        memcpy(kaddr, page->kaddr, PGSIZE);
+        shared_page_detach(page, vme);
+    }
+    lru_unlock();
+
+    return page != NULL;
 }
@@ -6,14 +6,37 @@
 #include "threads/synch.h"
 #include "vm/page.h"
 #include "threads/palloc.h"
+#include "filesys/off_t.h"
+
+extern void *zero_page;
 
 void lru_list_init(void);
+void pageout_init(size_t low, size_t high);
+void rss_limit_init(size_t limit);
 void add_page_to_lru_list(struct page* page);
 void del_page_from_lru_list(struct page *page);
 
 void try_to_free_pages(enum palloc_flags flags);
 struct page *alloc_page(enum palloc_flags flags);
+struct page *alloc_page_nowait(enum palloc_flags flags);
 void free_page(void *kaddr);
 void _free_page(struct page *page);
 
+bool map_shared_page(struct vm_entry *vme);
+bool shared_page_cached(struct vm_entry *vme);
+bool add_shared_page(struct page *page, struct vm_entry *vme);
+void unmap_vme_page(struct vm_entry *vme);
+void wait_page_io(struct vm_entry *vme);
+bool copy_shared_page(struct vm_entry *vme, void *kaddr);
+
+struct inode;
+void page_cache_read(struct inode *inode, off_t offset, void *buffer, size_t size);
+void page_cache_write(struct inode *inode, off_t offset, const void *buffer, size_t size);
+void page_cache_drop(struct inode *inode);
+bool map_cached_page(struct vm_entry *vme, bool *read_in);
+
+extern bool vm_trace;
+void vm_count_fault(struct vm_entry *vme, bool major);
+void vm_print_stats(void);
+
 #endif
\ No newline at end of file
@@ -20,10 +20,18 @@ static bool vm_less_func(const struct hash_elem *a, const struct hash_elem *b, v
     return vme_a->vaddr < vme_b->vaddr;
 }
 
+// Release the frame or swap slot backing vme
+static void vme_release(struct vm_entry *vme) {
+    unmap_vme_page(vme);
+    // A resident page may still have a clean copy in swap
+    if (vme->swap_slot != SWAP_NONE)
+        swap_free(vme->swap_slot);
+}
+
 // Destruction function for vm_entry elements in the hash table
 static void vm_destroy_func(struct hash_elem *e, void *aux) {
     struct vm_entry *vme = hash_entry(e, struct vm_entry, elem);
-    free_page(pagedir_get_page(thread_current()->pagedir, vme->vaddr));
+    vme_release(vme);
     free(vme);
 }
 
@@ -35,6 +43,9 @@ void vm_init(struct hash *vm) {
 // Insert a vm_entry into the virtual memory hash table
 bool insert_vme(struct hash *vm, struct vm_entry *vme) {
     vme->pinned = false;
+    vme->io_pending = false;
+    vme->thread = thread_current();
+    vme->swap_slot = SWAP_NONE;
     struct hash_elem *elem = hash_insert(vm, &(vme->elem));
     // hash_insert returns null on success
     return elem == NULL;
@@ -47,14 +58,179 @@ bool delete_vme(struct hash *vm, struct vm_entry *vme) {
     if (elem == NULL)
         return false;
     else {
-        free_page(pagedir_get_page(thread_current()->pagedir, vme->vaddr));
+        vme_release(vme);
         free(vme);
         return true;
     }
 }
 
-// Find a vm_entry based on the virtual address
+// Maximum size of a user stack, in pages
+static size_t stack_limit;
+
+// Lowest address a user stack may grow down to, where executables start
+#define STACK_FLOOR ((uint8_t *)0x08048000)
+
+// Ordering function for vm_areas by start address
+static bool vma_less(const struct list_elem *a, const struct list_elem *b, void *aux UNUSED) {
+    return list_entry(a, struct vm_area, elem)->start < list_entry(b, struct vm_area, elem)->start;
+}
+
+// Insert vma into the list of regions, kept sorted by address.  Fails if
+// the region leaves user space or overlaps another region or the area kept
+// for the stack to grow into.
+bool insert_vma(struct list *vma_list, struct vm_area *vma) {
+    uint8_t *stack_bottom = (uint8_t *)PHYS_BASE - stack_limit * PGSIZE;
+    struct list_elem *e;
+
+    if (!is_user_vaddr(vma->start) || vma->end <= vma->start
+        || (uint8_t *)vma->end > stack_bottom)
+        return false;
+
+    for (e = list_begin(vma_list); e != list_end(vma_list); e = list_next(e)) {
+        struct vm_area *other = list_entry(e, struct vm_area, elem);
+        if (other->start >= vma->end)
+            break;
+        if (other->end > vma->start)
+            return false;
+    }
+    list_insert_ordered(vma_list, &vma->elem, vma_less, NULL);
+    return true;
+}
+
+// Remove vma from the current process, releasing the vm_entries made for
+// its pages, and free it
+void delete_vma(struct hash *vm, struct vm_area *vma) {
+    uint8_t *upage;
+
+    for (upage = vma->start; upage < (uint8_t *)vma->end; upage += PGSIZE) {
+        struct vm_entry *vme = lookup_vme(upage);
+        if (vme != NULL)
+            delete_vme(vm, vme);
+    }
+    list_remove(&vma->elem);
+    free(vma);
+}
+
+// Find the region of the current process containing vaddr
+static struct vm_area *find_vma(void *vaddr) {
+    struct list *vma_list = &thread_current()->vma_list;
+    struct list_elem *e;
+
+    for (e = list_begin(vma_list); e != list_end(vma_list); e = list_next(e)) {
+        struct vm_area *vma = list_entry(e, struct vm_area, elem);
+        if (vma->start > vaddr)
+            break;
+        if (vma->end > vaddr)
+            return vma;
+    }
+    return NULL;
+}
+
+// Fill in vme to describe page upage of vma
+static void vma_fill_vme(struct vm_area *vma, uint8_t *upage, struct vm_entry *vme) {
+    size_t start = upage - (uint8_t *)vma->start;
+
+    vme->type = vma->type;
+    vme->vaddr = upage;
+    vme->writable = vma->writable;
+    vme->is_loaded = false;
+    vme->file = vma->file;
+    vme->offset = vma->offset + start;
+    if (vma->read_bytes <= start)
+        vme->read_bytes = 0;
+    else if (vma->read_bytes - start < PGSIZE)
+        vme->read_bytes = vma->read_bytes - start;
+    else
+        vme->read_bytes = PGSIZE;
+    vme->zero_bytes = PGSIZE - vme->read_bytes;
+    vme->swap_slot = SWAP_NONE;
+}
+
+// Make the vm_entry for page upage of vma and insert it into the current
+// process's table.  Returns NULL if out of memory.
+static struct vm_entry *vma_make_vme(struct vm_area *vma, uint8_t *upage) {
+    struct vm_entry *vme = malloc(sizeof *vme);
+
+    if (vme == NULL)
+        return NULL;
+    vma_fill_vme(vma, upage, vme);
+    insert_vme(&thread_current()->vm, vme);
+    return vme;
+}
+
+// Set the maximum size of user stacks to pages.  The stack keeps at least
+// its first page and may not reach down into the code segment, which
+// executables load at STACK_FLOOR; this also keeps stack_bottom from
+// wrapping below 0.
+void stack_limit_init(size_t pages) {
+    size_t max_pages = ((uintptr_t)PHYS_BASE - (uintptr_t)STACK_FLOOR) / PGSIZE;
+
+    if (pages < 1)
+        pages = 1;
+    if (pages > max_pages)
+        pages = max_pages;
+    stack_limit = pages;
+}
+
+// Create a vm_entry for the stack page holding addr if the access looks like
+// a push below the user stack pointer esp, as PUSHA reaches up to 32 bytes
+// below it, and keeps the stack within stack_limit pages.  The page is
+// zero-filled by handle_mm_fault() on first touch.  Returns the new
+// vm_entry, or NULL if addr is not a stack access.
+struct vm_entry *grow_stack(void *addr, void *esp) {
+    uint8_t *upage = pg_round_down(addr);
+    struct vm_entry *vme;
+
+    if (!is_user_vaddr(addr) || (uint8_t *)addr < (uint8_t *)esp - 32
+        || upage < (uint8_t *)PHYS_BASE - stack_limit * PGSIZE)
+        return NULL;
+
+    vme = malloc(sizeof *vme);
+    if (vme == NULL)
+        return NULL;
+    vme->type = VM_ANON;
+    vme->vaddr = upage;
+    vme->writable = true;
+    vme->is_loaded = false;
+    vme->file = NULL;
+    vme->offset = 0;
+    vme->read_bytes = 0;
+    vme->zero_bytes = PGSIZE;
+    if (!insert_vme(&thread_current()->vm, vme)) {
+        free(vme);
+        return NULL;
+    }
+    return vme;
+}
+
+// Find the vm_entry of the page holding vaddr, making it from the page's
+// region if the page has not been looked up before
 struct vm_entry *find_vme(void *vaddr) {
+    struct vm_entry *vme = lookup_vme(vaddr);
+    struct vm_area *vma;
+
+    if (vme != NULL)
+        return vme;
+    vma = find_vma(vaddr);
+    if (vma == NULL)
+        return NULL;
+    return vma_make_vme(vma, pg_round_down(vaddr));
+}
+
+// Fill in vme to describe the page holding vaddr, which has no vm_entry
+// yet, as find_vme() would make it, but without making it.  Returns false
+// if the page lies in no region.
+bool describe_vme(void *vaddr, struct vm_entry *vme) {
+    struct vm_area *vma = find_vma(vaddr);
+
+    if (vma == NULL)
+        return false;
+    vma_fill_vme(vma, pg_round_down(vaddr), vme);
+    return true;
+}
+
+// Find the vm_entry of the page holding vaddr if one has been made
+struct vm_entry *lookup_vme(void *vaddr) {
     struct thread *cur = thread_current();
     struct vm_entry search_entry;
 
@@ -70,18 +246,22 @@ struct vm_entry *find_vme(void *vaddr) {
         return NULL;
 }
 
-// Destroy the virtual memory hash table, freeing allocated memory
+// Destroy the virtual memory hash table and the regions of the current
+// process, freeing allocated memory
 void vm_destroy(struct hash *vm) {
+    struct list *vma_list = &thread_current()->vma_list;
+
     hash_destroy(vm, vm_destroy_func);
+    while (!list_empty(vma_list))
+        free(list_entry(list_pop_front(vma_list), struct vm_area, elem));
 }
 
 // Load data from a file into physical memory
 bool load_file(void *kaddr, struct vm_entry *vme) {
-    // Set the file offset to the vm_entry's offset
-    file_seek(vme->file, vme->offset);
-    
-    // Read data from the file into the physical page
-    if (file_read(vme->file, kaddr, vme->read_bytes) != (int)(vme->read_bytes)) {
+    // Read data from the file at the vm_entry's offset into the physical page.
+    // The file position is left alone, since the file is shared by every
+    // VM_BIN page of the process.
+    if (file_read_at(vme->file, kaddr, vme->read_bytes, vme->offset) != (int)(vme->read_bytes)) {
         return false;
     }
 
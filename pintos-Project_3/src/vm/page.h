@@ -10,17 +10,18 @@
 #define VM_FILE 1   /* Load data from a mapped file */
 #define VM_ANON 2   /* Load data from the swap area */
 
+struct inode;
+
 struct vm_entry {
     uint8_t type;           /* Type: VM_BIN, VM_FILE, VM_ANON */
     void *vaddr;            /* Virtual page number managed by vm_entry */
     bool writable;          /* True if write is allowed at this address */
     bool pinned;            /* True if the entry is pinned (not swappable) */
     bool is_loaded;         /* Flag indicating whether the data is loaded in physical memory */
+    struct thread *thread;  /* Thread whose address space the entry belongs to */
+    bool io_pending;        /* True while the page is written out without lru_list_lock */
     struct file *file;      /* File mapped to the virtual address */
 
-    /* For memory-mapped files (to be handled later) */
-    struct list_elem mmap_elem;   /* List element for mmap */
-
     size_t offset;          /* Offset in the file to be read */
     size_t read_bytes;      /* Size of data written to the virtual page */
     size_t zero_bytes;      /* Remaining bytes to be zero-filled in the page */
@@ -28,6 +29,9 @@ struct vm_entry {
     /* For swapping (to be handled later) */
     size_t swap_slot;       /* Swap slot */
 
+    /* For shared executable pages */
+    struct list_elem share_elem;  /* List element for the frame's sharers */
+
     /* Data structures for vm_entry (to be handled later) */
     struct hash_elem elem;  /* Hash table element */
 };
@@ -36,16 +40,59 @@ struct page {
     void *kaddr;            /* Physical address of the page */
     struct vm_entry *vme;   /* Pointer to the vm_entry representing the mapped virtual address */
     struct thread *thread;  /* Pointer to the thread using this physical page */
+    int64_t last_used;      /* Timer tick at which the page was last seen referenced */
     struct list_elem lru;   /* List element for LRU list */
+
+    /* A shared page caches read-only executable data and is mapped by every
+       vm_entry on its sharers list; vme and thread are then NULL */
+    bool shared;
+    struct inode *inode;    /* Executable the data comes from */
+    size_t offset;          /* Offset of the data in the executable */
+    size_t read_bytes;      /* Bytes of data, the rest being zeros */
+    struct list sharers;    /* vm_entries mapping the page */
+    int pin_cnt;            /* Users copying or writing out the page; not evictable */
+    struct hash_elem share_elem;  /* Element in the shared page table */
+    struct list_elem inode_elem;  /* Element in the inode's list of shared pages */
+};
+
+/* A run of pages of a process backed alike by a file, such as an
+   executable segment or a file mapping.  The vm_entry of each page is
+   made from the region when the page is first looked up, so setting up
+   a region costs the same whatever its size */
+struct vm_area {
+    uint8_t type;           /* Type of the pages: VM_BIN or VM_FILE */
+    void *start;            /* First page of the region */
+    void *end;              /* Page just past the region */
+    bool writable;          /* True if the pages may be written */
+    struct file *file;      /* File the pages are read from */
+    size_t offset;          /* Offset in the file of the first page */
+    size_t read_bytes;      /* Bytes of file data from start, the rest being zeros */
+    struct list_elem elem;  /* List element for the thread's vma_list */
+};
+
+/* A file mapped into memory by the mmap system call */
+struct mmap_file {
+    int mapid;              /* Mapping identifier returned by mmap */
+    struct file *file;      /* Private reopening of the mapped file */
+    struct list_elem elem;  /* List element for the thread's mmap_list */
+    struct vm_area *vma;    /* Region of the mapped pages */
 };
 
 void vm_init(struct hash *vm);
 bool insert_vme(struct hash *vm, struct vm_entry *vme);
 bool delete_vme(struct hash *vm, struct vm_entry *vme);
 
+bool insert_vma(struct list *vma_list, struct vm_area *vma);
+void delete_vma(struct hash *vm, struct vm_area *vma);
+
 struct vm_entry *find_vme(void *vaddr);
+struct vm_entry *lookup_vme(void *vaddr);
+bool describe_vme(void *vaddr, struct vm_entry *vme);
 void vm_destroy(struct hash *vm);
 
+void stack_limit_init(size_t pages);
+struct vm_entry *grow_stack(void *addr, void *esp);
+
 bool load_file(void *kaddr, struct vm_entry *vme);
 
 #endif /* VM_PAGE_H */
@@ -1,46 +1,178 @@
 #include "vm/swap.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
 #include "devices/block.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
 #include "vm/file.h"
 #include "vm/page.h"
+#include "vm/zswap.h"
 
 const size_t BLOCKS_PER_PAGE = PGSIZE / BLOCK_SECTOR_SIZE; // Number of blocks per page
 
 struct bitmap *swap_bitmap; // Bitmap indicating whether a particular index in the swap area is in use
+static struct lock swap_lock; // Protects swap_bitmap and swap_hint
+static size_t swap_hint;      // Slot just past the last allocation, where the next search starts
+static size_t swap_used_cnt, swap_peak_cnt;  // Slots in use now and at most, under swap_lock
 
-// Initialize the swap area
-void swap_init() {
-    swap_bitmap = bitmap_create(8 * 1024);
-}
+// Bounce buffer that gathers a cluster of pages into one contiguous
+// multi-sector request, and the lock that serializes its use
+static uint8_t *cluster_buf;
+static struct lock cluster_lock;
 
-// Copy data from the swap slot at used_index to the logical address kaddr
-void swap_in(size_t used_index, void *kaddr) {
+// Initialize the swap area, with one slot for every page that fits on the swap device
+void swap_init(void) {
     struct block *swap_disk = block_get_role(BLOCK_SWAP);
-    
-    if (bitmap_test(swap_bitmap, used_index)) {
-        int i;
-        for (i = 0; i < BLOCKS_PER_PAGE; i++) {
-            // Calculate the block sector to read and copy to the physical page
-            block_read(swap_disk, BLOCKS_PER_PAGE * used_index + i, BLOCK_SECTOR_SIZE * i + kaddr);
-        }
-        bitmap_reset(swap_bitmap, used_index);
+    size_t slot_cnt = swap_disk != NULL ? block_size(swap_disk) / BLOCKS_PER_PAGE : 0;
+
+    swap_bitmap = bitmap_create(slot_cnt);
+    if (swap_bitmap == NULL)
+        PANIC("swap bitmap creation failed--swap device is too large");
+    lock_init(&swap_lock);
+    swap_hint = 0;
+
+    cluster_buf = palloc_get_multiple(PAL_ASSERT, SWAP_CLUSTER);
+    lock_init(&cluster_lock);
+}
+
+// Allocate CNT consecutive free slots and return the first one, or BITMAP_ERROR.
+// Next-fit: the search resumes where the previous allocation ended and wraps
+// around once, so slots are not rescanned from 0 on every eviction.
+static size_t swap_alloc(size_t cnt) {
+    size_t slot;
+
+    lock_acquire(&swap_lock);
+    slot = bitmap_scan_and_flip(swap_bitmap, swap_hint, cnt, false);
+    if (slot == BITMAP_ERROR && swap_hint > 0)
+        slot = bitmap_scan_and_flip(swap_bitmap, 0, cnt, false);
+    if (slot != BITMAP_ERROR) {
+        swap_hint = slot + cnt;
+        swap_used_cnt += cnt;
+        if (swap_used_cnt > swap_peak_cnt)
+            swap_peak_cnt = swap_used_cnt;
     }
+    lock_release(&swap_lock);
+
+    return slot;
 }
 
 // Write the contents of the page pointed to by kaddr to the swap partition
 size_t swap_out(void *kaddr) {
+    size_t swap_index;
+
+    swap_out_cluster(&kaddr, &swap_index, 1);
+    return swap_index;
+}
+
+// Read the cnt consecutive slots starting at first_index into the pages
+// kaddrs[0..cnt-1] with a single multi-sector request.  The slots stay in
+// use, so that a page that stays clean keeps a valid copy in swap; the
+// caller frees each with swap_free() once it is no longer wanted.
+void swap_in_cluster(size_t first_index, void *kaddrs[], size_t cnt) {
     struct block *swap_disk = block_get_role(BLOCK_SWAP);
+    size_t i;
 
-    // Find the first false bit index using first-fit strategy
-    size_t swap_index = bitmap_scan(swap_bitmap, 0, 1, false);
+    ASSERT(cnt > 0 && cnt <= SWAP_CLUSTER);
+
+    // Compressed pages are only copied, one by one
+    if (zswap_slot(first_index)) {
+        for (i = 0; i < cnt; i++)
+            zswap_load(first_index + i, kaddrs[i]);
+        return;
+    }
 
-    if (BITMAP_ERROR != swap_index) {
-        int i;
-        for (i = 0; i < BLOCKS_PER_PAGE; i++) {
-            // Calculate the block sector to write from the physical page to the swap area
-            block_write(swap_disk, BLOCKS_PER_PAGE * swap_index + i, BLOCK_SECTOR_SIZE * i + kaddr);
+    if (cnt == 1) {
+        // A single page is read straight into place
+        block_read_multiple(swap_disk, BLOCKS_PER_PAGE * first_index, kaddrs[0], BLOCKS_PER_PAGE);
+    } else {
+        lock_acquire(&cluster_lock);
+        block_read_multiple(swap_disk, BLOCKS_PER_PAGE * first_index, cluster_buf, BLOCKS_PER_PAGE * cnt);
+        for (i = 0; i < cnt; i++)
+            memcpy(kaddrs[i], cluster_buf + i * PGSIZE, PGSIZE);
+        lock_release(&cluster_lock);
+    }
+}
+
+// Write the pages kaddrs[0..cnt-1] to the swap device and store each page's
+// slot in used_indexes[].  When cnt consecutive slots are free the pages go
+// to adjacent slots in one multi-sector request, so that swap_in_cluster()
+// can later read them back together; otherwise each page is written on its
+// own.
+static void swap_out_disk(void *kaddrs[], size_t used_indexes[], size_t cnt) {
+    struct block *swap_disk = block_get_role(BLOCK_SWAP);
+    size_t first_index, i;
+
+    ASSERT(cnt > 0 && cnt <= SWAP_CLUSTER);
+
+    // Find a run of free slots using next-fit
+    first_index = swap_alloc(cnt);
+    if (first_index != BITMAP_ERROR) {
+        for (i = 0; i < cnt; i++)
+            used_indexes[i] = first_index + i;
+
+        if (cnt == 1) {
+            // A single page is written straight from place
+            block_write_multiple(swap_disk, BLOCKS_PER_PAGE * first_index, kaddrs[0], BLOCKS_PER_PAGE);
+        } else {
+            lock_acquire(&cluster_lock);
+            for (i = 0; i < cnt; i++)
+                memcpy(cluster_buf + i * PGSIZE, kaddrs[i], PGSIZE);
+            block_write_multiple(swap_disk, BLOCKS_PER_PAGE * first_index, cluster_buf, BLOCKS_PER_PAGE * cnt);
+            lock_release(&cluster_lock);
         }
-        bitmap_set(swap_bitmap, swap_index, true);
+        return;
     }
 
-    return swap_index;
+    // No run long enough: fall back to one slot per page
+    for (i = 0; i < cnt; i++) {
+        used_indexes[i] = swap_alloc(1);
+        if (used_indexes[i] == BITMAP_ERROR)
+            PANIC("swap partition is full");
+        block_write_multiple(swap_disk, BLOCKS_PER_PAGE * used_indexes[i], kaddrs[i], BLOCKS_PER_PAGE);
+    }
+}
+
+// Write the pages kaddrs[0..cnt-1] to swap and store each page's slot in
+// used_indexes[].  Pages that compress well are kept compressed in memory;
+// the rest go to the swap device together.
+void swap_out_cluster(void *kaddrs[], size_t used_indexes[], size_t cnt) {
+    void *disk_kaddrs[SWAP_CLUSTER];
+    size_t disk_indexes[SWAP_CLUSTER];
+    size_t disk_cnt = 0, i, j;
+
+    ASSERT(cnt > 0 && cnt <= SWAP_CLUSTER);
+
+    for (i = 0; i < cnt; i++) {
+        used_indexes[i] = zswap_store(kaddrs[i]);
+        if (used_indexes[i] == SWAP_NONE)
+            disk_kaddrs[disk_cnt++] = kaddrs[i];
+    }
+    if (disk_cnt == 0)
+        return;
+
+    swap_out_disk(disk_kaddrs, disk_indexes, disk_cnt);
+    for (i = j = 0; i < cnt; i++)
+        if (used_indexes[i] == SWAP_NONE)
+            used_indexes[i] = disk_indexes[j++];
+}
+
+// Release the swap slot at used_index without reading it back
+void swap_free(size_t used_index) {
+    if (zswap_slot(used_index)) {
+        zswap_free(used_index);
+        return;
+    }
+
+    lock_acquire(&swap_lock);
+    bitmap_reset(swap_bitmap, used_index);
+    swap_used_cnt--;
+    lock_release(&swap_lock);
+}
+
+// Print swap statistics
+void swap_print_stats(void) {
+    printf("Swap: %zu of %zu slots in use, %zu at peak\n",
+           swap_used_cnt, bitmap_size(swap_bitmap), swap_peak_cnt);
+    zswap_print_stats();
 }
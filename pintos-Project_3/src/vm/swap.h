@@ -5,8 +5,15 @@
 #include <list.h>
 #include <bitmap.h>
 
-void swap_init();
-void swap_in(size_t used_index, void *kaddr);
+#define SWAP_CLUSTER 8      /* Most pages moved by one clustered swap request. */
+#define SWAP_NONE BITMAP_ERROR  /* swap_slot of a page with no copy in swap. */
+
+void swap_init(void);
 size_t swap_out(void *kaddr);
+void swap_free(size_t used_index);
+void swap_print_stats(void);
+
+void swap_in_cluster(size_t first_index, void *kaddrs[], size_t cnt);
+void swap_out_cluster(void *kaddrs[], size_t used_indexes[], size_t cnt);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,270 @@
+#include "vm/zswap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+// Compressed swap cache.  Pages going to swap are compressed into a pool of
+// kernel memory when they fit, so that swapping them back in is a memory
+// copy instead of a disk read.  Only pages that do not compress well, or
+// that find the pool full, go on to the swap device.
+//
+// The pool is carved into ZSWAP_UNIT-byte units; a compressed page takes a
+// run of them.  Each stored page has an entry recording where its data is,
+// and the entry's index, offset by ZSWAP_BASE, serves as its swap slot.
+
+#define ZSWAP_UNIT 64                     // Bytes per pool allocation unit
+#define ZSWAP_MAX_SIZE (PGSIZE * 3 / 4)   // Largest compressed page worth keeping
+
+struct zswap_entry {
+    size_t unit;    // First unit of the compressed data
+    size_t size;    // Bytes of compressed data
+};
+
+static uint8_t *pool;                  // Compressed data, pool_units units
+static size_t pool_units;
+static struct bitmap *unit_map;        // Units in use
+static struct bitmap *entry_map;       // Entries in use
+static struct zswap_entry *entries;    // One per unit, the most pages that fit
+static struct lock zswap_lock;         // Protects all of the above and the buffers below
+
+// Statistics, under zswap_lock
+static size_t stored_cnt, stored_bytes, peak_cnt;
+static long long store_cnt, reject_cnt, full_cnt, load_cnt;
+
+// Compression scratch space, under zswap_lock: the compressed output, and a
+// hash table from 4-byte sequences to the page offset they were last seen at
+static uint8_t *comp_buf;
+#define HASH_BITS 12
+static uint16_t hash_table[1 << HASH_BITS];
+
+// Set up a pool of PAGES kernel pages to hold compressed pages.  With no
+// pages, or if the memory cannot be had, every page goes to the swap device.
+void zswap_init(size_t pages) {
+    lock_init(&zswap_lock);
+    if (pages == 0)
+        return;
+
+    pool = palloc_get_multiple(0, pages);
+    comp_buf = palloc_get_page(0);
+    pool_units = pages * PGSIZE / ZSWAP_UNIT;
+    unit_map = bitmap_create(pool_units);
+    entry_map = bitmap_create(pool_units);
+    entries = malloc(pool_units * sizeof *entries);
+    if (pool == NULL || comp_buf == NULL || unit_map == NULL || entry_map == NULL
+        || entries == NULL) {
+        printf("zswap: cannot allocate %zu page pool, disabled\n", pages);
+        palloc_free_multiple(pool, pages);
+        palloc_free_page(comp_buf);
+        bitmap_destroy(unit_map);
+        bitmap_destroy(entry_map);
+        free(entries);
+        pool = NULL;
+        pool_units = 0;
+    }
+}
+
+static uint32_t read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof v);
+    return v;
+}
+
+// Append the length n, less the part that fit in the token nibble, as a run
+// of 255s ending in a smaller byte
+static uint8_t *put_len(uint8_t *op, size_t n) {
+    while (n >= 255) {
+        *op++ = 255;
+        n -= 255;
+    }
+    *op++ = n;
+    return op;
+}
+
+// Append a sequence of lit_len literals from lit, followed by a match of
+// match_len bytes at offset back from the output position, or by nothing if
+// match_len is 0.  Returns the new end of output, or NULL past oend.
+static uint8_t *put_sequence(uint8_t *op, uint8_t *oend, const uint8_t *lit, size_t lit_len,
+                             size_t offset, size_t match_len) {
+    size_t ml = match_len > 0 ? match_len - 4 : 0;
+
+    // Token, extended lengths, literals and offset, at most
+    if ((size_t)(oend - op) < 1 + lit_len / 255 + 1 + lit_len + 2 + ml / 255 + 1)
+        return NULL;
+
+    *op++ = (lit_len < 15 ? lit_len : 15) << 4 | (ml < 15 ? ml : 15);
+    if (lit_len >= 15)
+        op = put_len(op, lit_len - 15);
+    memcpy(op, lit, lit_len);
+    op += lit_len;
+    if (match_len > 0) {
+        *op++ = offset & 0xff;
+        *op++ = offset >> 8;
+        if (ml >= 15)
+            op = put_len(op, ml - 15);
+    }
+    return op;
+}
+
+// Compress the len bytes at src into at most cap bytes at dst, in the LZ4
+// block format: each sequence is a token holding the literal and match
+// lengths, the literals, and the match's 2-byte offset, with the final
+// sequence having literals only.  Returns the compressed size, or 0 if it
+// would exceed cap.
+static size_t lz_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap) {
+    const uint8_t *ip = src, *anchor = src, *end = src + len;
+    uint8_t *op = dst, *oend = dst + cap;
+
+    memset(hash_table, 0, sizeof hash_table);
+    while (ip + 4 <= end) {
+        uint32_t seq = read32(ip);
+        size_t h = (seq * 2654435761u) >> (32 - HASH_BITS);
+        const uint8_t *ref = src + hash_table[h];
+        size_t match_len;
+
+        hash_table[h] = ip - src;
+        if (ref >= ip || read32(ref) != seq) {
+            ip++;
+            continue;
+        }
+
+        for (match_len = 4; ip + match_len < end && ref[match_len] == ip[match_len]; match_len++)
+            continue;
+        op = put_sequence(op, oend, anchor, ip - anchor, ip - ref, match_len);
+        if (op == NULL)
+            return 0;
+        ip += match_len;
+        anchor = ip;
+    }
+
+    op = put_sequence(op, oend, anchor, end - anchor, 0, 0);
+    return op != NULL ? (size_t)(op - dst) : 0;
+}
+
+// Read a length extension written by put_len()
+static size_t get_len(const uint8_t **ip) {
+    size_t n = 0;
+    uint8_t b;
+
+    do {
+        b = *(*ip)++;
+        n += b;
+    } while (b == 255);
+    return n;
+}
+
+// Decompress the len bytes at src, written by lz_compress(), into the
+// PGSIZE bytes at dst
+static void lz_decompress(const uint8_t *src, size_t len, uint8_t *dst) {
+    const uint8_t *ip = src, *iend = src + len;
+    uint8_t *op = dst;
+
+    while (ip < iend) {
+        uint8_t token = *ip++;
+        size_t lit_len = token >> 4;
+        size_t match_len = token & 15;
+        const uint8_t *ref;
+
+        if (lit_len == 15)
+            lit_len += get_len(&ip);
+        memcpy(op, ip, lit_len);
+        op += lit_len;
+        ip += lit_len;
+        if (ip >= iend)
+            break;
+
+        ref = op - (ip[0] | ip[1] << 8);
+        ip += 2;
+        if (match_len == 15)
+            match_len += get_len(&ip);
+        match_len += 4;
+
+        // The match may overlap the bytes it produces, so copy bytewise
+        while (match_len-- > 0)
+            *op++ = *ref++;
+    }
+    ASSERT(op == dst + PGSIZE);
+}
+
+// Compress the page at kaddr into the pool.  Returns its swap slot, or
+// SWAP_NONE (BITMAP_ERROR) if the page does not compress well enough or the
+// pool has no room, in which case it belongs on the swap device.
+size_t zswap_store(const void *kaddr) {
+    size_t size, units, unit, entry;
+
+    if (pool == NULL)
+        return BITMAP_ERROR;
+
+    lock_acquire(&zswap_lock);
+    store_cnt++;
+    size = lz_compress(kaddr, PGSIZE, comp_buf, ZSWAP_MAX_SIZE);
+    if (size == 0) {
+        reject_cnt++;
+        lock_release(&zswap_lock);
+        return BITMAP_ERROR;
+    }
+
+    units = DIV_ROUND_UP(size, ZSWAP_UNIT);
+    unit = bitmap_scan_and_flip(unit_map, 0, units, false);
+    if (unit == BITMAP_ERROR) {
+        full_cnt++;
+        lock_release(&zswap_lock);
+        return BITMAP_ERROR;
+    }
+    // There is an entry per unit, so one is free
+    entry = bitmap_scan_and_flip(entry_map, 0, 1, false);
+    entries[entry].unit = unit;
+    entries[entry].size = size;
+    memcpy(pool + unit * ZSWAP_UNIT, comp_buf, size);
+
+    stored_cnt++;
+    stored_bytes += size;
+    if (stored_cnt > peak_cnt)
+        peak_cnt = stored_cnt;
+    lock_release(&zswap_lock);
+
+    return ZSWAP_BASE + entry;
+}
+
+// Decompress the page in slot into kaddr.  The slot stays in use until
+// zswap_free().
+void zswap_load(size_t slot, void *kaddr) {
+    struct zswap_entry *e = &entries[slot - ZSWAP_BASE];
+
+    lock_acquire(&zswap_lock);
+    lz_decompress(pool + e->unit * ZSWAP_UNIT, e->size, kaddr);
+    load_cnt++;
+    lock_release(&zswap_lock);
+}
+
+// Release slot without reading it back
+void zswap_free(size_t slot) {
+    size_t entry = slot - ZSWAP_BASE;
+    struct zswap_entry *e = &entries[entry];
+
+    ASSERT(entry < pool_units);
+
+    lock_acquire(&zswap_lock);
+    ASSERT(bitmap_test(entry_map, entry));
+    bitmap_set_multiple(unit_map, e->unit, DIV_ROUND_UP(e->size, ZSWAP_UNIT), false);
+    bitmap_reset(entry_map, entry);
+    stored_cnt--;
+    stored_bytes -= e->size;
+    lock_release(&zswap_lock);
+}
+
+// Print compressed swap statistics
+void zswap_print_stats(void) {
+    if (pool == NULL)
+        return;
+    printf("Zswap: %zu pages in %zu of %zu bytes, %zu at peak\n",
+           stored_cnt, stored_bytes, pool_units * ZSWAP_UNIT, peak_cnt);
+    printf("Zswap: %lld stores, %lld incompressible, %lld pool full, %lld loads\n",
+           store_cnt, reject_cnt, full_cnt, load_cnt);
+}
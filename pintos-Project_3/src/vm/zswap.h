@@ -0,0 +1,22 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Swap slots at or above ZSWAP_BASE name pages kept compressed in memory;
+// the ones below name slots on the swap device
+#define ZSWAP_BASE ((size_t) 1 << 30)
+
+void zswap_init(size_t pages);
+size_t zswap_store(const void *kaddr);
+void zswap_load(size_t slot, void *kaddr);
+void zswap_free(size_t slot);
+void zswap_print_stats(void);
+
+// Return true if slot names a page kept compressed in memory
+static inline bool zswap_slot(size_t slot) {
+    return slot >= ZSWAP_BASE;
+}
+
+#endif